@@ -18,6 +18,7 @@
 #define REG_FIFO_RX_CURRENT_ADDR 0x10
 #define REG_IRQ_FLAGS 0x12
 #define REG_RX_NB_BYTES 0x13
+#define REG_MODEM_STAT 0x18
 #define REG_PKT_SNR_VALUE 0x19
 #define REG_PKT_RSSI_VALUE 0x1a
 #define REG_MODEM_CONFIG_1 0x1d
@@ -46,25 +47,41 @@
 #define MODE_TX 0x03
 #define MODE_RX_CONTINUOUS 0x05
 #define MODE_RX_SINGLE 0x06
+#define MODE_CAD 0x07
 
 // PA config
 #define PA_BOOST 0x80
 
 // IRQ masks
+#define IRQ_CAD_DETECTED_MASK 0x01
+#define IRQ_CAD_DONE_MASK 0x04
 #define IRQ_TX_DONE_MASK 0x08
 #define IRQ_PAYLOAD_CRC_ERROR_MASK 0x20
 #define IRQ_RX_DONE_MASK 0x40
 
+// modem status masks
+#define MODEM_STAT_SIGNAL_DETECTED 0x01
+#define MODEM_STAT_SIGNAL_SYNCHRONIZED 0x02
+#define MODEM_STAT_HEADER_INFO_VALID 0x08
+
 #define MAX_PKT_LENGTH 255
 
+#if defined(ARDUINO_ARCH_ESP32)
+#define ISR_PREFIX IRAM_ATTR
+#else
+#define ISR_PREFIX
+#endif
+
 
 LoRaClass::LoRaClass() : _spiSettings(LORA_DEFAULT_SPI_FREQUENCY, MSBFIRST, SPI_MODE0),
                          _spi(&LORA_DEFAULT_SPI),
                          _ss(LORA_DEFAULT_SS_PIN), _reset(LORA_DEFAULT_RESET_PIN), _dio0(LORA_DEFAULT_DIO0_PIN),
                          _frequency(0),
-                         _packetIndex(0)
+                         _packetIndex(0),
+                         _onDio0(NULL),
+                         _registerWrites(0)
 {
-
+  invalidateShadow();
 }
 
 int LoRaClass::begin(long frequency)
@@ -84,6 +101,8 @@ int LoRaClass::begin(long frequency)
     digitalWrite(_reset, HIGH);
     delay(10);
   }
+  // registers back to their reset values, or unknown without reset pin
+  invalidateShadow();
 
   // start SPI
   _spi->begin();
@@ -139,10 +158,19 @@ int LoRaClass::beginPacket()
   return 1;
 }
 
-int LoRaClass::endPacket()
+int LoRaClass::endPacket(bool async)
 {
+  if (async)
+  {
+    writeRegister(REG_DIO_MAPPING_1, 0x40); // DIO0 => TXDONE
+  }
   // put in TX mode
   writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_TX);
+  if (async)
+  {
+    // TX done is reported on DIO0, or polled with txDone()
+    return 1;
+  }
   // wait for TX done
   while ((readRegister(REG_IRQ_FLAGS) & IRQ_TX_DONE_MASK) == 0)
   {
@@ -153,6 +181,17 @@ int LoRaClass::endPacket()
   return 1;
 }
 
+bool LoRaClass::txDone()
+{
+  if ((readRegister(REG_IRQ_FLAGS) & IRQ_TX_DONE_MASK) == 0)
+  {
+    return false;
+  }
+  // clear IRQ's
+  writeRegister(REG_IRQ_FLAGS, IRQ_TX_DONE_MASK);
+  return true;
+}
+
 bool LoRaClass::isTransmitting()
 {
   if ((readRegister(REG_OP_MODE) & MODE_TX) == MODE_TX)
@@ -204,6 +243,11 @@ size_t LoRaClass::write(uint8_t byte)
 }
 
 size_t LoRaClass::write(const uint8_t *buffer, size_t size)
+{
+  return writeFifo(buffer, size);
+}
+
+size_t LoRaClass::writeFifo(const uint8_t *buffer, size_t size)
 {
   int currentLength = readRegister(REG_PAYLOAD_LENGTH);
 
@@ -213,11 +257,22 @@ size_t LoRaClass::write(const uint8_t *buffer, size_t size)
     size = MAX_PKT_LENGTH - currentLength;
   }
 
-  // write data
+  // write data, FIFO address is auto incremented by the transceiver
+  digitalWrite(_ss, LOW);
+
+  _spi->beginTransaction(_spiSettings);
+  _spi->transfer(REG_FIFO | 0x80);
+#if defined(ARDUINO_ARCH_ESP32)
+  _spi->writeBytes(buffer, size);
+#else
   for (size_t i = 0; i < size; i++)
   {
-    writeRegister(REG_FIFO, buffer[i]);
+    _spi->transfer(buffer[i]);
   }
+#endif
+  _spi->endTransaction();
+
+  digitalWrite(_ss, HIGH);
 
   // update length
   writeRegister(REG_PAYLOAD_LENGTH, currentLength + size);
@@ -225,6 +280,35 @@ size_t LoRaClass::write(const uint8_t *buffer, size_t size)
   return size;
 }
 
+size_t LoRaClass::readFifo(uint8_t *buffer, size_t size)
+{
+  int remaining = available();
+
+  // check size
+  if (remaining <= 0)
+  {
+    return 0;
+  }
+  if (size > (size_t)remaining)
+  {
+    size = remaining;
+  }
+
+  // read data, FIFO address is auto incremented by the transceiver
+  digitalWrite(_ss, LOW);
+
+  _spi->beginTransaction(_spiSettings);
+  _spi->transfer(REG_FIFO & 0x7f);
+  _spi->transfer(buffer, size);
+  _spi->endTransaction();
+
+  digitalWrite(_ss, HIGH);
+
+  _packetIndex += size;
+
+  return size;
+}
+
 int LoRaClass::available()
 {
   return (readRegister(REG_RX_NB_BYTES) - _packetIndex);
@@ -268,6 +352,32 @@ void LoRaClass::receive(int size)
   writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_RX_CONTINUOUS);
 }
 
+void LoRaClass::channelActivityDetection()
+{
+  writeRegister(REG_DIO_MAPPING_1, 0x80); // DIO0 => CADDONE
+  writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_CAD);
+}
+
+int LoRaClass::cadResult()
+{
+  int irqFlags = readRegister(REG_IRQ_FLAGS);
+
+  if ((irqFlags & IRQ_CAD_DONE_MASK) == 0)
+  {
+    // CAD still running
+    return -1;
+  }
+  // clear IRQ's
+  writeRegister(REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+  return (irqFlags & IRQ_CAD_DETECTED_MASK) ? 1 : 0;
+}
+
+bool LoRaClass::isReceiving()
+{
+  // only meaningful in receive mode: a preamble was detected, or a packet is being received
+  return (readRegister(REG_MODEM_STAT) & (MODEM_STAT_SIGNAL_DETECTED | MODEM_STAT_SIGNAL_SYNCHRONIZED | MODEM_STAT_HEADER_INFO_VALID)) != 0;
+}
+
 void LoRaClass::idle()
 {
   writeRegister(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
@@ -526,6 +636,18 @@ void LoRaClass::setOCP(uint8_t mA)
   writeRegister(REG_OCP, 0x20 | (0x1F & ocpTrim));
 }
 
+int LoRaClass::reconfigure(long frequency, int sf, long sbw, int denominator)
+{
+  // modem settings are changed in standby, the caller puts the transceiver back to rx or cad
+  idle();
+  uint32_t writes = _registerWrites;
+  setFrequency(frequency);
+  setSpreadingFactor(sf);
+  setSignalBandwidth(sbw);
+  setCodingRate4(denominator);
+  return _registerWrites - writes;
+}
+
 byte LoRaClass::random()
 {
   return readRegister(REG_RSSI_WIDEBAND);
@@ -538,18 +660,87 @@ void LoRaClass::setPins(int ss, int reset, int dio0)
   _dio0 = dio0;
 }
 
+void LoRaClass::onDio0(void (*callback)(void))
+{
+  _onDio0 = callback;
+
+  if (callback)
+  {
+    pinMode(_dio0, INPUT);
+    attachInterrupt(digitalPinToInterrupt(_dio0), LoRaClass::onDio0Rise, RISING);
+  }
+  else
+  {
+    detachInterrupt(digitalPinToInterrupt(_dio0));
+  }
+}
+
 void LoRaClass::explicitHeaderMode()
 {
   writeRegister(REG_MODEM_CONFIG_1, readRegister(REG_MODEM_CONFIG_1) & 0xfe);
 }
 
+bool LoRaClass::isShadowed(uint8_t address)
+{
+  // configuration registers only, never changed by the transceiver itself
+  switch (address)
+  {
+  case REG_FRF_MSB:
+  case REG_FRF_MID:
+  case REG_FRF_LSB:
+  case REG_PA_CONFIG:
+  case REG_OCP:
+  case REG_FIFO_TX_BASE_ADDR:
+  case REG_FIFO_RX_BASE_ADDR:
+  case REG_MODEM_CONFIG_1:
+  case REG_MODEM_CONFIG_2:
+  case REG_PREAMBLE_MSB:
+  case REG_PREAMBLE_LSB:
+  case REG_MODEM_CONFIG_3:
+  case REG_DETECTION_OPTIMIZE:
+  case REG_INVERTIQ:
+  case REG_DETECTION_THRESHOLD:
+  case REG_SYNC_WORD:
+  case REG_INVERTIQ2:
+  case REG_DIO_MAPPING_1:
+  case REG_PA_DAC:
+    return true;
+  }
+  return false;
+}
+
+void LoRaClass::invalidateShadow()
+{
+  memset(_shadowValid, 0, sizeof(_shadowValid));
+}
+
 uint8_t LoRaClass::readRegister(uint8_t address)
 {
-  return singleTransfer(address & 0x7f, 0x00);
+  if (!isShadowed(address))
+  {
+    return singleTransfer(address & 0x7f, 0x00);
+  }
+  if (!bitRead(_shadowValid[address / 8], address % 8))
+  {
+    _shadow[address] = singleTransfer(address & 0x7f, 0x00);
+    bitSet(_shadowValid[address / 8], address % 8);
+  }
+  return _shadow[address];
 }
 
 void LoRaClass::writeRegister(uint8_t address, uint8_t value)
 {
+  if (isShadowed(address))
+  {
+    if (bitRead(_shadowValid[address / 8], address % 8) && (_shadow[address] == value))
+    {
+      // already set, no SPI transfer
+      return;
+    }
+    _shadow[address] = value;
+    bitSet(_shadowValid[address / 8], address % 8);
+  }
+  _registerWrites++;
   singleTransfer(address | 0x80, value);
 }
 
@@ -569,4 +760,18 @@ uint8_t LoRaClass::singleTransfer(uint8_t address, uint8_t value)
   return response;
 }
 
+ISR_PREFIX void LoRaClass::handleDio0Rise()
+{
+  // interrupt context: no SPI access here, IRQ flags are read by the callback owner
+  if (_onDio0)
+  {
+    _onDio0();
+  }
+}
+
+ISR_PREFIX void LoRaClass::onDio0Rise()
+{
+  LoRa.handleDio0Rise();
+}
+
 LoRaClass LoRa;
\ No newline at end of file
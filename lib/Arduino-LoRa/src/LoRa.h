@@ -24,6 +24,9 @@
 #define PA_OUTPUT_RFO_PIN          0
 #define PA_OUTPUT_PA_BOOST_PIN     1
 
+// configuration registers are shadowed up to REG_PA_DAC
+#define LORA_SHADOW_SIZE           0x4e
+
 class LoRaClass {
 public:
   LoRaClass();
@@ -32,7 +35,8 @@ public:
   void end();
   // explicit
   int beginPacket();
-  int endPacket();
+  int endPacket(bool async = false);
+  bool txDone();
 
   int availablePacket();
   int packetRssi();
@@ -47,12 +51,20 @@ public:
   virtual int read();
   virtual int peek();
 
+  // burst FIFO access, one SPI transaction for the whole payload
+  size_t readFifo(uint8_t *buffer, size_t size);
+  size_t writeFifo(const uint8_t *buffer, size_t size);
+
 #ifndef ARDUINO_SAMD_MKRWAN1300
   void receive(int size = 0);
 #endif
   void idle();
   void sleep();
 
+  void channelActivityDetection();
+  int cadResult();
+  bool isReceiving();
+
   void setTxPower(int level, int outputPin = PA_OUTPUT_PA_BOOST_PIN);
   void setFrequency(long frequency);
   void setSpreadingFactor(int sf);
@@ -67,6 +79,12 @@ public:
   
   void setOCP(uint8_t mA); // Over Current Protection control
 
+  // differential reconfiguration, no reset: only the registers that changed are written
+  int reconfigure(long frequency, int sf, long sbw, int denominator);
+  uint32_t registerWrites() { return _registerWrites; }
+
+  void onDio0(void (*callback)(void)); // callback runs in interrupt context
+
   // deprecated
   void crc() { enableCrc(); }
   void noCrc() { disableCrc(); }
@@ -91,6 +109,9 @@ private:
   void writeRegister(uint8_t address, uint8_t value);
   uint8_t singleTransfer(uint8_t address, uint8_t value);
 
+  static bool isShadowed(uint8_t address);
+  void invalidateShadow();
+
   static void onDio0Rise();
 
 
@@ -102,6 +123,11 @@ private:
   int _dio0;
   long _frequency;
   int _packetIndex;
+  void (*_onDio0)(void);
+  // last value read or written of the configuration registers, valid bit per register
+  uint8_t _shadow[LORA_SHADOW_SIZE];
+  uint8_t _shadowValid[(LORA_SHADOW_SIZE + 7) / 8];
+  uint32_t _registerWrites;
 };
 
 extern LoRaClass LoRa;
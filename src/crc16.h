@@ -0,0 +1,47 @@
+/**
+ * @file crc16.h
+ * @author mchacher
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <Arduino.h>
+
+/**
+ * @brief CRC16 ccitt backends
+ * BITWISE reference implementation, one bit at a time
+ * TABLE one 256 entries table lookup per byte
+ * SLICE4 four 256 entries tables, 4 bytes per iteration
+ * ROM ESP32 ROM crc16_be routine
+ */
+#define CRC16_BACKEND_BITWISE 0
+#define CRC16_BACKEND_TABLE 1
+#define CRC16_BACKEND_SLICE4 2
+#define CRC16_BACKEND_ROM 3
+
+/**
+ * @def CRC16_BACKEND
+ * @brief backend used by crc16_ccitt, can be overridden with a build flag (-DCRC16_BACKEND=...)
+ */
+#ifndef CRC16_BACKEND
+#define CRC16_BACKEND CRC16_BACKEND_TABLE
+#endif
+
+// uncomment to run the CRC16 benchmark at boot and report the results as log messages
+// #define CRC16_BENCHMARK
+
+uint16_t crc16_ccitt(const uint8_t *data, unsigned int data_len);
+uint16_t crc16_ccitt_bitwise(const uint8_t *data, unsigned int data_len);
+uint16_t crc16_ccitt_table(const uint8_t *data, unsigned int data_len);
+uint16_t crc16_ccitt_slice4(const uint8_t *data, unsigned int data_len);
+#if defined(ARDUINO_ARCH_ESP32)
+uint16_t crc16_ccitt_rom(const uint8_t *data, unsigned int data_len);
+#endif
+#ifdef CRC16_BENCHMARK
+void crc16_benchmark(void);
+#endif
+
+#endif
@@ -9,8 +9,13 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <esp_timer.h>
 #include "data_storage.h"
 #include "lora_home_configuration.h"
+#include "crc16.h"
+#ifdef DATA_STORAGE_BENCHMARK
+#include "serial_api.h"
+#endif
 
 /**
  * @brief name of the DATA_ZONE
@@ -20,10 +25,6 @@ const char *DATA_ZONE = "loradongle";
 
 Preferences prefs;
 
-uint32_t bandwidth = 0;
-uint32_t spreading_factor = 0;
-uint32_t coding_rate = 0;
-
 /**
  * @brief key - frequency channel
  * 
@@ -54,6 +55,62 @@ const char *KEY_CR = "K_CR";
  */
 const char *KEY_NID = "K_NID";
 
+/**
+ * @brief key - uart baud rate
+ * 
+ */
+const char *KEY_BAUD = "K_BAUD";
+
+/**
+ * @brief key - uart framing
+ * 
+ */
+const char *KEY_FRAMING = "K_FRM";
+
+/**
+ * @brief key - configuration blob, replacing the key per field data above since version 1
+ * 
+ */
+const char *KEY_CONFIG = "K_CFG";
+
+/**
+ * @brief version of the configuration blob layout, to be increased on any change
+ * 
+ */
+const uint8_t DATA_STORAGE_VERSION = 1;
+
+/**
+ * @brief whole dongle configuration, stored as a single NVS entry
+ * fields sized explicitly, the layout must not depend on the compiler, crc16 over all the fields before it
+ * 
+ * @return typedef struct 
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint8_t version;
+    uint32_t channel;
+    uint32_t bandwidth;
+    uint32_t spreading_factor;
+    uint32_t coding_rate;
+    uint16_t network_id;
+    uint32_t baud_rate;
+    uint8_t framing;
+    uint16_t crc16;
+} DATA_STORAGE_BLOB;
+
+/**
+ * @brief configuration blob as last read from or written to NVS, to skip writes when nothing changed
+ * 
+ */
+DATA_STORAGE_BLOB stored_blob = {};
+
+// config_load_us - time to load the configuration at boot, migration included on the first boot after an upgrade
+uint32_t DataStorage::config_load_us = 0;
+// config_save_counter - each time a configuration command saves the configuration
+uint32_t DataStorage::config_save_counter = 0;
+// config_write_counter - each time an NVS entry is written
+uint32_t DataStorage::config_write_counter = 0;
+
 /**
  * @brief lora configuration
  * 
@@ -86,6 +143,14 @@ uint16_t lora_home_network_id = 0;
  */
 const uint16_t default_network_id = 0xACDC;
 
+/**
+ * @brief uart link settings, negotiated with the host
+ * 
+ */
+UART_LINK_SETTINGS uart_link = {
+    .baud_rate = UART_BAUD_RATE,
+    .framing = UART_FRAMING_STUFFING};
+
 /**
  * @brief Construct a new Data Storage:: Data Storage object
  * 
@@ -104,57 +169,160 @@ void DataStorage::init()
 }
 
 /**
- * @brief load dongle configuration in NSV. Lora settings and Lora  Home Network ID
+ * @brief read the configuration blob from NVS, and check it
+ *
+ * @param blob configuration blob read
+ * @return true if present, of the current version and its crc is valid
+ * @return false otherwise
+ */
+static bool data_storage_read_blob(DATA_STORAGE_BLOB *blob)
+{
+    if (!prefs.isKey(KEY_CONFIG) || (prefs.getBytes(KEY_CONFIG, blob, sizeof(DATA_STORAGE_BLOB)) != sizeof(DATA_STORAGE_BLOB)))
+    {
+        return false;
+    }
+    if (DATA_STORAGE_VERSION != blob->version)
+    {
+        return false;
+    }
+    return (blob->crc16 == crc16_ccitt((uint8_t *)blob, offsetof(DATA_STORAGE_BLOB, crc16)));
+}
+
+/**
+ * @brief read the key per field data stored before the configuration blob, 0 if missing
+ *
+ * @param blob configuration blob filled in with the data read
+ */
+static void data_storage_read_legacy(DATA_STORAGE_BLOB *blob)
+{
+    blob->channel = prefs.getUInt(KEY_CH, 0);
+    blob->bandwidth = prefs.getUInt(KEY_BW, 0);
+    blob->spreading_factor = prefs.getUInt(KEY_SF, 0);
+    blob->coding_rate = prefs.getUInt(KEY_CR, 0);
+    blob->network_id = prefs.getUShort(KEY_NID, 0);
+    blob->baud_rate = prefs.getUInt(KEY_BAUD, 0);
+    blob->framing = prefs.getUInt(KEY_FRAMING, UART_FRAMING_STUFFING);
+}
+
+/**
+ * @brief write the actual configuration in NVS as a blob, only if it differs from the stored one
+ *
+ * @return true if the blob in NVS holds the actual configuration, written or unchanged
+ * @return false if the write failed
+ */
+static bool data_storage_write_blob()
+{
+    DATA_STORAGE_BLOB blob;
+    blob.version = DATA_STORAGE_VERSION;
+    blob.channel = lora_config.channel;
+    blob.bandwidth = lora_config.bandwidth;
+    blob.spreading_factor = lora_config.spreading_factor;
+    blob.coding_rate = lora_config.coding_rate;
+    blob.network_id = lora_home_network_id;
+    blob.baud_rate = uart_link.baud_rate;
+    blob.framing = uart_link.framing;
+    blob.crc16 = crc16_ccitt((uint8_t *)&blob, offsetof(DATA_STORAGE_BLOB, crc16));
+    if (0 == memcmp(&blob, &stored_blob, sizeof(DATA_STORAGE_BLOB)))
+    {
+        return true;
+    }
+    if (sizeof(DATA_STORAGE_BLOB) != prefs.putBytes(KEY_CONFIG, &blob, sizeof(DATA_STORAGE_BLOB)))
+    {
+        return false;
+    }
+    stored_blob = blob;
+    DataStorage::config_write_counter++;
+    return true;
+}
+
+/**
+ * @brief load dongle configuration in NSV. Lora settings, Lora  Home Network ID and uart link settings
+ * a single blob lookup, the key per field data of previous versions is migrated to the blob on the first boot
  *
  */
 void DataStorage::load_configuration()
 {
-    Lora_Frequency_Channel ch = (Lora_Frequency_Channel)prefs.getUInt(KEY_CH, 0);
-    if (ch != 0)
+    int64_t start = esp_timer_get_time();
+    DATA_STORAGE_BLOB blob;
+    bool migrate = !data_storage_read_blob(&blob);
+    if (migrate)
     {
-        lora_config.channel = ch;
+        // first boot after an upgrade, or blob corrupted: key per field data, defaults if none
+        data_storage_read_legacy(&blob);
+    }
+    else
+    {
+        stored_blob = blob;
+    }
+    if (blob.channel != 0)
+    {
+        lora_config.channel = (Lora_Frequency_Channel)blob.channel;
     }
     else
     {
         lora_config.channel = lora_default_config.channel;
     }
-    Lora_Signal_Bandwidth bw = (Lora_Signal_Bandwidth)prefs.getUInt(KEY_BW, 0);
-    if (bw != 0)
+    if (blob.bandwidth != 0)
     {
-        lora_config.bandwidth = bw;
+        lora_config.bandwidth = (Lora_Signal_Bandwidth)blob.bandwidth;
     }
     else
     {
         lora_config.bandwidth = lora_default_config.bandwidth;
     }
-
-    Lora_Spreading_Factor sf = (Lora_Spreading_Factor)prefs.getUInt(KEY_SF, 0);
-    if (sf != 0)
+    if (blob.spreading_factor != 0)
     {
-        lora_config.spreading_factor = sf;
+        lora_config.spreading_factor = (Lora_Spreading_Factor)blob.spreading_factor;
     }
     else
     {
         lora_config.spreading_factor = lora_default_config.spreading_factor;
     }
-    Lora_Coding_Rate cr = (Lora_Coding_Rate)prefs.getUInt(KEY_CR, 0);
-    if (cr != 0)
+    if (blob.coding_rate != 0)
     {
-        lora_config.coding_rate = cr;
+        lora_config.coding_rate = (Lora_Coding_Rate)blob.coding_rate;
     }
     else
     {
         lora_config.coding_rate = lora_default_config.coding_rate;
     }
-    uint16_t n_id = prefs.getUShort(KEY_NID, 0);
-    if (n_id != 0)
+    if (blob.network_id != 0)
     {
-        lora_home_network_id = n_id;
+        lora_home_network_id = blob.network_id;
     }
     else
     {
         lora_home_network_id = default_network_id;
     }
+    if (uart_is_valid_baud_rate(blob.baud_rate))
+    {
+        uart_link.baud_rate = blob.baud_rate;
+    }
+    else
+    {
+        uart_link.baud_rate = UART_BAUD_RATE;
+    }
+    if (blob.framing < UART_FRAMING_COUNT)
+    {
+        uart_link.framing = (UART_FRAMING)blob.framing;
+    }
+    else
+    {
+        uart_link.framing = UART_FRAMING_STUFFING;
+    }
+    // the key per field data is removed only once the blob holding it is written, migrated again on the next boot otherwise
+    if (migrate && data_storage_write_blob())
+    {
+        const char *legacy_keys[] = {KEY_CH, KEY_BW, KEY_SF, KEY_CR, KEY_NID, KEY_BAUD, KEY_FRAMING};
+        for (uint8_t i = 0; i < sizeof(legacy_keys) / sizeof(legacy_keys[0]); i++)
+        {
+            if (prefs.isKey(legacy_keys[i]))
+            {
+                prefs.remove(legacy_keys[i]);
+            }
+        }
+    }
+    config_load_us = (uint32_t)(esp_timer_get_time() - start);
 }
 
 /**
@@ -180,15 +348,34 @@ void DataStorage::set_lora_home_network_id(uint16_t value)
 
 /**
  * @brief save actual configuration in persistent memory (NSV)
+ * flash written only if the configuration changed
  * 
  */
 void DataStorage::save_configuration()
 {
-    prefs.putUInt(KEY_CH, lora_config.channel);
-    prefs.putUInt(KEY_BW, lora_config.bandwidth);
-    prefs.putUInt(KEY_SF, lora_config.spreading_factor);
-    prefs.putUInt(KEY_CR, lora_config.coding_rate);
-    prefs.putUShort(KEY_NID, lora_home_network_id);
+    config_save_counter++;
+    data_storage_write_blob();
+}
+
+/**
+ * @brief assessor
+ * 
+ * @return UART_LINK_SETTINGS uart baud rate and framing
+ */
+UART_LINK_SETTINGS DataStorage::get_uart_link()
+{
+    return uart_link;
+}
+
+/**
+ * @brief set and save to persistent memory
+ * 
+ * @param link uart baud rate and framing
+ */
+void DataStorage::set_uart_link(const UART_LINK_SETTINGS *link)
+{
+    uart_link = *link;
+    this->save_configuration();
 }
 
 /**
@@ -217,4 +404,34 @@ LORA_CONFIGURATION DataStorage::get_lora_configuration()
         return lora_config;
     }
     return lora_default_config;
-}
\ No newline at end of file
+}
+#ifdef DATA_STORAGE_BENCHMARK
+/**
+ * @brief time the configuration load, one blob lookup against the seven key lookups of previous versions
+ * each per key lookup is done even if the key was migrated, it costs the same search in NVS
+ * writes are not benchmarked to spare the flash, config_write_counter against config_save_counter gives them
+ *
+ */
+void DataStorage::benchmark()
+{
+    const uint16_t iterations = 100;
+    DATA_STORAGE_BLOB blob;
+    char log[128];
+
+    int64_t start = esp_timer_get_time();
+    for (uint16_t i = 0; i < iterations; i++)
+    {
+        data_storage_read_legacy(&blob);
+    }
+    uint32_t legacy_us = (uint32_t)(esp_timer_get_time() - start) / iterations;
+    start = esp_timer_get_time();
+    for (uint16_t i = 0; i < iterations; i++)
+    {
+        data_storage_read_blob(&blob);
+    }
+    uint32_t blob_us = (uint32_t)(esp_timer_get_time() - start) / iterations;
+    snprintf(log, sizeof(log), "config load: key per field %lu us, blob %lu us, boot load %lu us", (unsigned long)legacy_us,
+             (unsigned long)blob_us, (unsigned long)config_load_us);
+    serial_api_send_log_message(log);
+}
+#endif
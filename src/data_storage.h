@@ -9,6 +9,10 @@
 #define DATA_STORAGE_H
 
 #include "lora_home_configuration.h"
+#include "uart.h"
+
+// uncomment to compare the boot time load of the configuration blob with the key per field load it replaced, reported as a log message
+// #define DATA_STORAGE_BENCHMARK
 
 class DataStorage
 {
@@ -20,6 +24,16 @@ public:
     uint16_t get_lora_home_network_id();
     void set_lora_home_network_id(uint16_t value);
     void set_lora_configuration(LORA_CONFIGURATION *lc);
+    UART_LINK_SETTINGS get_uart_link();
+    void set_uart_link(const UART_LINK_SETTINGS *link);
+#ifdef DATA_STORAGE_BENCHMARK
+    void benchmark();
+#endif
+
+public:
+    static uint32_t config_load_us;
+    static uint32_t config_save_counter;
+    static uint32_t config_write_counter;
 
 private:
     void save_configuration();
@@ -11,7 +11,63 @@
 
 #define HEARTBEAT_PERIOD 5000
 
+// time in ms for the host to confirm a new baud rate or framing with an echo, before falling back to the previous one
+#define LINK_CONFIRM_TIMEOUT 2000
+
 #define ACK_TIMEOUT 300
 #define MAX_RETRY_NO_VALID_ACK 3 
+// max number of downlinks waiting for their node ACK at the same time
+#define MAX_INFLIGHT_DOWNLINKS 8
+// downlinks the host may have queued in the dongle, at most the depth of a tx queue so a downlink within credit is never dropped
+#define DOWNLINK_CREDITS 5
+
+// uncomment to set the LoRa sync word from the network id (lora_home_sync_word), the transceiver then drops most frames
+// of other networks before they reach the MCU, nodes must use the same sync word
+// #define LORA_SYNC_WORD_FILTER
+
+// comment to transmit without listen before talk (Channel Activity Detection before each transmission)
+#define LORA_LBT
+// random backoff (ms) when the channel is busy
+#define LBT_BACKOFF_MIN 10
+#define LBT_BACKOFF_MAX 100
+// max number of channel checks before transmitting anyway
+#define LBT_MAX_ATTEMPTS 5
+// max number of channel checks of a gateway ACK, its backoffs must end before the node stops waiting for it (ACK_TIMEOUT)
+#define LBT_ACK_MAX_ATTEMPTS 2
+// max time (ms) to wait for CadDone
+#define LORA_CAD_TIMEOUT 500
+// period (ms) to check a frame still being received once locked on a scanned channel
+#define LORA_SCAN_POLL 10
+
+// duty cycle limit per sub-band (ETSI EN 300 220, 1%) over a sliding window (ms)
+#define DUTY_CYCLE_PERCENT 1
+#define DUTY_CYCLE_WINDOW 3600000UL
+
+// comment to poll the LoRa transceiver every 10ms instead of waiting for DIO0 (RxDone) interrupts
+#define LORA_DIO0_INTERRUPT
+// max time (ms) the LoRa task waits for a DIO0 interrupt or a tx request before checking the transceiver anyway
+#define LORA_TASK_WAIT_TIMEOUT 1000
+// max time (ms) to wait for TxDone before giving up a transmission (max frame at SF12 / 125kHz is ~5.3s on air)
+#define LORA_TX_TIMEOUT 6000
+
+// max time (ms) a pipeline task (uart, lora home send/receive, sys) blocks on its input before checking again
+#define PIPELINE_TASK_WAIT_TIMEOUT 1000
+// uncomment to let frames queued within this window (ms) join the uart tx burst of the first one, e.g. heartbeat plus uplinks
+// #define UART_TX_COALESCE_MS 2
+
+// max bandwidth (bytes/s) of the binary log frames shipped to the host, about 5% of the link at 115200 baud
+#define LOG_RATE_LIMIT 512
+// period (ms) the log task ships the records of the log ring
+#define LOG_SHIP_PERIOD 100
+
+// uncomment to run the whole pipeline (uart, serial api, sys, LoRa) in a single reactor task, instead of one task per stage
+// #define SINGLE_REACTOR
+// stack size of the reactor task
+#define REACTOR_TASK_STACK_SIZE 6144
+// stack size of each pipeline task, and of the LoRa task, when not SINGLE_REACTOR
+#define PIPELINE_TASK_STACK_SIZE 2048
+#define LORA_TASK_STACK_SIZE 10000
+// stack size of the log task, in both modes
+#define LOG_TASK_STACK_SIZE 2048
 
 #endif 
\ No newline at end of file
@@ -0,0 +1,161 @@
+/**
+ * @file duty_cycle.cpp
+ * @author mchacher
+ * @brief  duty cycle accounting of LoRa transmissions
+ * compute the time on air of a frame for the active lora configuration
+ * keep a sliding window airtime budget per ETSI sub-band (DUTY_CYCLE_PERCENT of DUTY_CYCLE_WINDOW)
+ * not thread safe, to be used by the LoRa task only
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <Arduino.h>
+#include "duty_cycle.h"
+#include "dongle_configuration.h"
+
+// preamble length, as set by LoRa.begin()
+#define LORA_PREAMBLE_LENGTH 8
+// slot duration in ms
+#define DUTY_CYCLE_SLOT_DURATION (DUTY_CYCLE_WINDOW / DUTY_CYCLE_SLOTS)
+// airtime budget in ms over the window
+#define DUTY_CYCLE_BUDGET (DUTY_CYCLE_WINDOW / 100 * DUTY_CYCLE_PERCENT)
+// one extra slot so that airtime is released at least DUTY_CYCLE_WINDOW after the transmission
+#define DUTY_CYCLE_RING (DUTY_CYCLE_SLOTS + 1)
+
+/**
+ * @brief airtime accounting of a sub-band
+ * airtime[i] is the airtime (ms) used during slot i modulo DUTY_CYCLE_RING
+ *
+ * @return typedef struct
+ */
+typedef struct
+{
+  uint32_t airtime[DUTY_CYCLE_RING];
+  uint32_t last_slot;
+} DUTY_CYCLE_ACCOUNT;
+
+static DUTY_CYCLE_ACCOUNT accounts[SUB_BAND_COUNT] = {};
+
+/**
+ * @brief get the sub-band of a frequency
+ *
+ * @param frequency frequency in Hz
+ * @return DUTY_CYCLE_SUB_BAND
+ */
+static DUTY_CYCLE_SUB_BAND duty_cycle_sub_band(long frequency)
+{
+  if (frequency < 868000000)
+  {
+    return SUB_BAND_G;
+  }
+  return SUB_BAND_G1;
+}
+
+/**
+ * @brief slide the window of a sub-band up to now, releasing expired slots
+ *
+ * @param frequency frequency in Hz
+ * @return DUTY_CYCLE_ACCOUNT* the account of the sub-band
+ */
+static DUTY_CYCLE_ACCOUNT *duty_cycle_account(long frequency)
+{
+  DUTY_CYCLE_ACCOUNT *account = &accounts[duty_cycle_sub_band(frequency)];
+  uint32_t slot = millis() / DUTY_CYCLE_SLOT_DURATION;
+  uint32_t elapsed = slot - account->last_slot;
+  if (elapsed > DUTY_CYCLE_RING)
+  {
+    elapsed = DUTY_CYCLE_RING;
+  }
+  for (uint32_t i = 1; i <= elapsed; i++)
+  {
+    account->airtime[(account->last_slot + i) % DUTY_CYCLE_RING] = 0;
+  }
+  account->last_slot = slot;
+  return account;
+}
+
+/**
+ * @brief compute the time on air of a frame (Semtech AN1200.13)
+ * explicit header, CRC on, low data rate optimization when symbol duration exceeds 16ms
+ *
+ * @param lc lora configuration
+ * @param size frame size in bytes
+ * @return uint32_t time on air in ms, rounded up
+ */
+uint32_t duty_cycle_time_on_air(const LORA_CONFIGURATION *lc, uint8_t size)
+{
+  int32_t sf = lc->spreading_factor;
+  int32_t cr = constrain((int32_t)lc->coding_rate, 5, 8) - 4;
+  // symbol duration in us
+  uint64_t t_sym = ((uint64_t)1000000 << sf) / lc->bandwidth;
+  int32_t de = (t_sym > 16000) ? 1 : 0;
+  // payload symbols
+  int32_t num = 8 * size - 4 * sf + 28 + 16;
+  int32_t den = 4 * (sf - 2 * de);
+  int32_t n_payload = 8;
+  if (num > 0)
+  {
+    n_payload += ((num + den - 1) / den) * (cr + 4);
+  }
+  // preamble is (n + 4.25) symbols
+  uint64_t t_us = (t_sym * (4 * LORA_PREAMBLE_LENGTH + 17)) / 4 + t_sym * n_payload;
+  return (uint32_t)((t_us + 999) / 1000);
+}
+
+/**
+ * @brief airtime left in the sliding window of the sub-band
+ *
+ * @param frequency frequency in Hz
+ * @return uint32_t remaining airtime in ms
+ */
+uint32_t duty_cycle_remaining(long frequency)
+{
+  DUTY_CYCLE_ACCOUNT *account = duty_cycle_account(frequency);
+  uint32_t used = 0;
+  for (uint8_t i = 0; i < DUTY_CYCLE_RING; i++)
+  {
+    used += account->airtime[i];
+  }
+  return (used < DUTY_CYCLE_BUDGET) ? (DUTY_CYCLE_BUDGET - used) : 0;
+}
+
+/**
+ * @brief time to wait until the budget of the sub-band allows a transmission
+ *
+ * @param frequency frequency in Hz
+ * @param time_on_air time on air of the frame in ms
+ * @return uint32_t 0 if the frame can be sent now, else time to wait in ms
+ */
+uint32_t duty_cycle_wait(long frequency, uint32_t time_on_air)
+{
+  uint32_t remaining = duty_cycle_remaining(frequency);
+  if (time_on_air <= remaining)
+  {
+    return 0;
+  }
+  DUTY_CYCLE_ACCOUNT *account = duty_cycle_account(frequency);
+  uint32_t next_slot_ts = (account->last_slot + 1) * DUTY_CYCLE_SLOT_DURATION;
+  // oldest slots expire first
+  for (uint8_t i = 1; i <= DUTY_CYCLE_RING; i++)
+  {
+    remaining += account->airtime[(account->last_slot + i) % DUTY_CYCLE_RING];
+    if (time_on_air <= remaining)
+    {
+      return (next_slot_ts - millis()) + (i - 1) * DUTY_CYCLE_SLOT_DURATION;
+    }
+  }
+  // frame longer than the whole budget
+  return DUTY_CYCLE_WINDOW;
+}
+
+/**
+ * @brief account the airtime of a transmission
+ *
+ * @param frequency frequency in Hz
+ * @param time_on_air time on air of the frame in ms
+ */
+void duty_cycle_register(long frequency, uint32_t time_on_air)
+{
+  DUTY_CYCLE_ACCOUNT *account = duty_cycle_account(frequency);
+  account->airtime[account->last_slot % DUTY_CYCLE_RING] += time_on_air;
+}
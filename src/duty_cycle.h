@@ -0,0 +1,37 @@
+/**
+ * @file duty_cycle.h
+ * @author mchacher
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef DUTY_CYCLE_H
+#define DUTY_CYCLE_H
+
+#include <Arduino.h>
+#include "lora_home_configuration.h"
+
+/**
+ * @def DUTY_CYCLE_SLOTS
+ * @brief number of slots of the sliding window, each one accounting the airtime of DUTY_CYCLE_WINDOW / DUTY_CYCLE_SLOTS ms
+ */
+#define DUTY_CYCLE_SLOTS 60
+
+/**
+ * @brief ETSI EN 300 220 sub-bands used by the lora home channels
+ * SUB_BAND_G 865.0 - 868.0 MHz (CH_1, CH_2)
+ * SUB_BAND_G1 868.0 - 868.6 MHz (CH_3)
+ */
+typedef enum
+{
+  SUB_BAND_G = 0,
+  SUB_BAND_G1 = 1,
+  SUB_BAND_COUNT
+} DUTY_CYCLE_SUB_BAND;
+
+uint32_t duty_cycle_time_on_air(const LORA_CONFIGURATION *lc, uint8_t size);
+uint32_t duty_cycle_remaining(long frequency);
+uint32_t duty_cycle_wait(long frequency, uint32_t time_on_air);
+void duty_cycle_register(long frequency, uint32_t time_on_air);
+
+#endif
@@ -0,0 +1,241 @@
+/**
+ * @file log_ring.cpp
+ * @author mchacher
+ * @brief tokenized logging, cheap enough for the forwarding paths
+ * a log is recorded as its ID and raw arguments in a lock-free ring, no formatting on the dongle
+ * a low priority task ships the records to the host as binary SERIAL_MSG_TYPE_LOG frames, under a bandwidth cap,
+ * formatted by the host decoder (tools/log_decoder.py)
+ * binary frame: LOG_RING_FRAME_MARKER, then records of ts (uint32_t, ms), id (uint8_t), argc (uint8_t), argc args (uint32_t)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <Arduino.h>
+#include "log_ring.h"
+#include "serial_api.h"
+#include "packet_pool.h"
+#include "dongle_configuration.h"
+
+static_assert(0 == (LOG_RING_SIZE & (LOG_RING_SIZE - 1)), "log ring size must be a power of 2");
+static_assert(LOG_ID_COUNT <= 256, "log IDs are sent as a byte");
+
+/**
+ * @brief record of the log ring
+ * sequence, as in a bounded MPMC queue: equal to its position when free, position + 1 once written, to be shipped
+ *
+ * @return typedef struct
+ */
+typedef struct
+{
+  uint32_t sequence;
+  uint32_t ts;
+  uint8_t id;
+  uint8_t argc;
+  uint32_t args[LOG_RING_MAX_ARGS];
+} LOG_RING_RECORD;
+
+/**
+ * @brief header of a record in a binary log frame, followed by its arguments
+ *
+ * @return typedef struct
+ */
+typedef struct __attribute__((__packed__))
+{
+  uint32_t ts;
+  uint8_t id;
+  uint8_t argc;
+} LOG_RING_RECORD_HEADER;
+
+static LOG_RING_RECORD log_ring[LOG_RING_SIZE];
+// next position to be written, claimed by the producers
+static uint32_t log_ring_head = 0;
+// next position to be shipped, only moved by the log task
+static uint32_t log_ring_tail = 0;
+// bytes the log task may still send, refilled at LOG_RATE_LIMIT
+static int32_t log_ring_budget = 0;
+static unsigned long log_ring_budget_ts = 0;
+// log_ring_drop_counter - each time a record is dropped because the ring is full
+uint32_t log_ring_drop_counter = 0;
+// drops already reported to the host
+static uint32_t log_ring_drop_reported = 0;
+
+/**
+ * @brief record a log, from any task, never blocks
+ * dropped if the ring is full, the drops are reported to the host with the next records shipped
+ *
+ * @param id log ID
+ * @param argc number of arguments, at most LOG_RING_MAX_ARGS
+ * @param args raw arguments, formatted by the host
+ */
+void log_ring_put(LOG_ID id, uint8_t argc, const uint32_t *args)
+{
+  uint32_t pos = __atomic_load_n(&log_ring_head, __ATOMIC_RELAXED);
+  LOG_RING_RECORD *record;
+  while (1)
+  {
+    record = &log_ring[pos & (LOG_RING_SIZE - 1)];
+    int32_t diff = (int32_t)(__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) - pos);
+    if (0 == diff)
+    {
+      // claim the record, pos reloaded if another producer was faster
+      if (__atomic_compare_exchange_n(&log_ring_head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      {
+        break;
+      }
+    }
+    else if (diff < 0)
+    {
+      // not shipped yet, ring full
+      __atomic_fetch_add(&log_ring_drop_counter, 1, __ATOMIC_RELAXED);
+      return;
+    }
+    else
+    {
+      pos = __atomic_load_n(&log_ring_head, __ATOMIC_RELAXED);
+    }
+  }
+  if (argc > LOG_RING_MAX_ARGS)
+  {
+    argc = LOG_RING_MAX_ARGS;
+  }
+  record->ts = millis();
+  record->id = id;
+  record->argc = argc;
+  memcpy(record->args, args, argc * sizeof(uint32_t));
+  __atomic_store_n(&record->sequence, pos + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief get a record written and not shipped yet
+ *
+ * @param pos position of the record, from log_ring_tail
+ * @return LOG_RING_RECORD* the record, NULL if not written yet
+ */
+static LOG_RING_RECORD *log_ring_peek(uint32_t pos)
+{
+  LOG_RING_RECORD *record = &log_ring[pos & (LOG_RING_SIZE - 1)];
+  if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != (pos + 1))
+  {
+    return NULL;
+  }
+  return record;
+}
+
+/**
+ * @brief free the records shipped, for the producers to write them again
+ *
+ * @param count number of records, from log_ring_tail
+ */
+static void log_ring_release(uint32_t count)
+{
+  for (uint32_t i = 0; i < count; i++)
+  {
+    LOG_RING_RECORD *record = &log_ring[log_ring_tail & (LOG_RING_SIZE - 1)];
+    __atomic_store_n(&record->sequence, log_ring_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+    log_ring_tail++;
+  }
+}
+
+/**
+ * @brief append a record to a binary log frame
+ *
+ * @param frame binary log frame
+ * @param size frame size
+ * @param ts record timestamp
+ * @param id log ID
+ * @param argc number of arguments
+ * @param args arguments
+ * @return uint8_t frame size with the record, unchanged if it does not fit
+ */
+static uint8_t log_ring_append(uint8_t *frame, uint8_t size, uint32_t ts, uint8_t id, uint8_t argc, const uint32_t *args)
+{
+  uint8_t args_size = argc * sizeof(uint32_t);
+  if ((size + sizeof(LOG_RING_RECORD_HEADER) + args_size) > (PACKET_POOL_BLOCK_SIZE - PACKET_POOL_HEADROOM))
+  {
+    return size;
+  }
+  LOG_RING_RECORD_HEADER header = {ts, id, argc};
+  memcpy(&frame[size], &header, sizeof(LOG_RING_RECORD_HEADER));
+  memcpy(&frame[size + sizeof(LOG_RING_RECORD_HEADER)], args, args_size);
+  return size + sizeof(LOG_RING_RECORD_HEADER) + args_size;
+}
+
+/**
+ * @brief ship the records of the ring as binary log frames, within the bandwidth left
+ * records stay in the ring while the budget is spent, uplinks keep at least half of the packet buffers
+ *
+ */
+void log_ring_process()
+{
+  unsigned long now = millis();
+  log_ring_budget += (int32_t)(((now - log_ring_budget_ts) * LOG_RATE_LIMIT) / 1000);
+  log_ring_budget_ts = now;
+  if (log_ring_budget > LOG_RATE_LIMIT)
+  {
+    log_ring_budget = LOG_RATE_LIMIT;
+  }
+  while ((log_ring_budget > 0) && (packet_pool_available() > (PACKET_POOL_SIZE / 2)))
+  {
+    uint8_t frame[PACKET_POOL_BLOCK_SIZE - PACKET_POOL_HEADROOM];
+    uint8_t size = 0;
+    frame[size++] = LOG_RING_FRAME_MARKER;
+    uint32_t dropped = __atomic_load_n(&log_ring_drop_counter, __ATOMIC_RELAXED) - log_ring_drop_reported;
+    if (0 != dropped)
+    {
+      size = log_ring_append(frame, size, now, LOG_ID_LOG_DROPPED, 1, &dropped);
+    }
+    uint32_t count = 0;
+    LOG_RING_RECORD *record;
+    while (NULL != (record = log_ring_peek(log_ring_tail + count)))
+    {
+      uint8_t next = log_ring_append(frame, size, record->ts, record->id, record->argc, record->args);
+      if (next == size)
+      {
+        break;
+      }
+      size = next;
+      count++;
+    }
+    if ((0 == count) && (0 == dropped))
+    {
+      break;
+    }
+    SERIAL_API_IOV iov = {frame, size};
+    if (!serial_api_sendv(SERIAL_MSG_TYPE_LOG, &iov, 1))
+    {
+      // uart busy, records kept for the next period
+      break;
+    }
+    log_ring_release(count);
+    log_ring_drop_reported += dropped;
+    log_ring_budget -= sizeof(SERIAL_PACKET_HEADER) + size;
+  }
+}
+
+/**
+ * @brief initialize the log ring, before any log is recorded
+ *
+ */
+void log_ring_init()
+{
+  for (uint32_t i = 0; i < LOG_RING_SIZE; i++)
+  {
+    log_ring[i].sequence = i;
+  }
+  log_ring_head = 0;
+  log_ring_tail = 0;
+}
+
+/**
+ * @brief FreeRTOS task
+ * ship the log records every LOG_SHIP_PERIOD, at low priority
+ * @param pvParameters not used
+ */
+void task_log(void *pvParameters)
+{
+  while (1)
+  {
+    vTaskDelay(pdMS_TO_TICKS(LOG_SHIP_PERIOD));
+    log_ring_process();
+  }
+}
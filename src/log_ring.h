@@ -0,0 +1,121 @@
+/**
+ * @file log_ring.h
+ * @author mchacher
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <Arduino.h>
+
+/**
+ * @def LOG_RING_SIZE
+ * @brief The number of records in the log ring, a power of 2.
+ */
+#define LOG_RING_SIZE 64
+/**
+ * @def LOG_RING_MAX_ARGS
+ * @brief The max number of raw arguments of a record.
+ */
+#define LOG_RING_MAX_ARGS 4
+/**
+ * @def LOG_RING_FRAME_MARKER
+ * @brief The first byte of a binary log frame, text log messages never start with it.
+ */
+#define LOG_RING_FRAME_MARKER 0x00
+
+/**
+ * @brief log IDs and their format, one X(id, format) per line
+ * only the ID and the raw arguments are recorded, the format is applied by the host decoder (tools/log_decoder.py)
+ * which parses this list: append new IDs at the end, never reorder nor remove, arguments are uint32_t (%d reads them signed)
+ *
+ */
+#define LOG_RING_IDS(X)                                                                                          \
+  X(LOG_ID_LOG_DROPPED, "log: %u records dropped, ring full")                                                    \
+  X(LOG_ID_BOOT, "boot: version %u.%u.%u")                                                                       \
+  X(LOG_ID_LORA_SETTINGS, "lora settings: channel %u, bandwidth %u, coding rate %u, spreading factor %u")        \
+  X(LOG_ID_ALL_SETTINGS, "sending all settings")                                                                 \
+  X(LOG_ID_NETWORK_ID, "network id = %04x")                                                                      \
+  X(LOG_ID_DOWNLINK, "downlink: node %u, counter %u, %u bytes")                                                  \
+  X(LOG_ID_LINK_CHANGE, "link change: baud rate %u, framing %u, status %u")                                      \
+  X(LOG_ID_CREDIT_OVERRUN, "downlink beyond credit: %u received, limit %u")                                      \
+  X(LOG_ID_TX_DROP, "tx queue full: class %u, packet dropped")                                                   \
+  X(LOG_ID_RX_ERROR, "rx error: %u bytes, reason %u")                                                            \
+  X(LOG_ID_LBT_FORCED, "channel busy after %u checks, transmitting anyway")                                      \
+  X(LOG_ID_TX_TIMEOUT, "no TxDone after %u ms")                                                                  \
+  X(LOG_ID_DOWNLINK_LOST, "downlink lost: node %u, counter %u, %u transmissions")                                \
+  X(LOG_ID_RETUNE, "lora retune: deaf %u us, %u registers written, %u ms after the request")
+
+#define LOG_RING_ID_ENUM(id, format) id,
+
+/**
+ * @brief log IDs
+ *
+ */
+typedef enum
+{
+  LOG_RING_IDS(LOG_RING_ID_ENUM)
+  LOG_ID_COUNT
+} LOG_ID;
+
+/**
+ * @brief reasons of LOG_ID_RX_ERROR
+ *
+ */
+typedef enum
+{
+  LOG_RX_ERROR_SIZE = 0,
+  LOG_RX_ERROR_NO_BUFFER = 1,
+  LOG_RX_ERROR_CRC = 2,
+  LOG_RX_ERROR_MSG_TYPE = 3
+} LOG_RX_ERROR;
+
+extern uint32_t log_ring_drop_counter;
+
+void log_ring_put(LOG_ID id, uint8_t argc, const uint32_t *args);
+void log_ring_init();
+void log_ring_process();
+void task_log(void *pvParameters);
+
+/**
+ * @brief record a log, without argument
+ *
+ * @param id log ID
+ */
+static inline void log_ring_put(LOG_ID id)
+{
+  log_ring_put(id, 0, NULL);
+}
+
+/**
+ * @brief record a log, with raw arguments, formatted by the host
+ *
+ * @param id log ID
+ */
+static inline void log_ring_put(LOG_ID id, uint32_t a0)
+{
+  uint32_t args[] = {a0};
+  log_ring_put(id, 1, args);
+}
+
+static inline void log_ring_put(LOG_ID id, uint32_t a0, uint32_t a1)
+{
+  uint32_t args[] = {a0, a1};
+  log_ring_put(id, 2, args);
+}
+
+static inline void log_ring_put(LOG_ID id, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+  uint32_t args[] = {a0, a1, a2};
+  log_ring_put(id, 3, args);
+}
+
+static inline void log_ring_put(LOG_ID id, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+  uint32_t args[] = {a0, a1, a2, a3};
+  log_ring_put(id, 4, args);
+}
+
+#endif
@@ -24,10 +24,12 @@
  * CH_1 867.4 MHz
  * CH_2 867.7 MHz
  * CH_3 868.0 MHz
+ * CH_SCAN is not a frequency: the gateway scans LORA_SCAN_CHANNELS
  */
 enum Lora_Frequency_Channel
 {
     CH_NONE = 0,
+    CH_SCAN = 1,
     CH_1 = 867400000,
     CH_2 = 867700000,
     CH_3 = 868000000
@@ -96,6 +98,39 @@ enum Lora_Coding_Rate
     CR_8 = 8
 };
 
+/**
+ * @brief channels scanned in CH_SCAN mode
+ * downlinks are sent on the channel the node was last heard on, LORA_SCAN_DEFAULT_CHANNEL if never heard
+ */
+const Lora_Frequency_Channel LORA_SCAN_CHANNELS[] = {CH_1, CH_2, CH_3};
+const uint8_t LORA_SCAN_CHANNEL_COUNT = sizeof(LORA_SCAN_CHANNELS) / sizeof(LORA_SCAN_CHANNELS[0]);
+const Lora_Frequency_Channel LORA_SCAN_DEFAULT_CHANNEL = CH_3;
+
+/**
+ * @brief LoRa sync words
+ * DEFAULT SX127x reset value, for private networks, LORAWAN reserved to LoRaWAN public networks
+ */
+const uint8_t LORA_SYNC_WORD_DEFAULT = 0x12;
+const uint8_t LORA_SYNC_WORD_LORAWAN = 0x34;
+
+/**
+ * @brief sync word of a lora home network, for the transceiver to drop the frames of other networks
+ * gateway and nodes must use the same: the network id folded on a byte, reserved sync words avoided
+ * several network ids share each sync word, their frames still reach the MCU and are dropped on their network id
+ *
+ * @param network_id lora home network id
+ * @return uint8_t sync word
+ */
+static inline uint8_t lora_home_sync_word(uint16_t network_id)
+{
+    uint8_t sync_word = (uint8_t)(network_id ^ (network_id >> 8));
+    if ((LORA_SYNC_WORD_DEFAULT == sync_word) || (LORA_SYNC_WORD_LORAWAN == sync_word))
+    {
+        sync_word = ~sync_word;
+    }
+    return sync_word;
+}
+
 typedef struct
 {
     enum Lora_Frequency_Channel channel;
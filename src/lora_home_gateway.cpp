@@ -16,19 +16,42 @@
 #include <ArduinoJson.h>
 #include <LoRa.h>
 #include "esp_task_wdt.h"
+#include <esp_system.h>
+#include <esp_timer.h>
 #include "lora_home_configuration.h"
 #include "serial_api.h"
 #include "dongle_configuration.h"
+#include "crc16.h"
+#include "duty_cycle.h"
+#include "node_table.h"
+#include "perf_stats.h"
+#include "reactor.h"
+#include "log_ring.h"
 
 // White LED management of heltec_wifi_lora_32_V2 board
 #define LED_WHITE 25
 
-// rx LoRa packet queue
-QueueHandle_t LoRaHomeGateway::rx_packet_queue = xQueueCreate(5, LH_FRAME_MAX_SIZE * sizeof(uint8_t));
-// rx LoRa ACK queue
-QueueHandle_t LoRaHomeGateway::rx_ack_packet_queue = xQueueCreate(5, LH_FRAME_ACK_SIZE * sizeof(uint8_t));
-// tx LoRa queue
-QueueHandle_t LoRaHomeGateway::tx_packet_queue = xQueueCreate(5, LH_FRAME_MAX_SIZE * sizeof(uint8_t));
+// lora home frame of a packet buffer, after the room kept for the serial packet header
+#define LH_FRAME(packet) (&(packet)->data[PACKET_POOL_HEADROOM])
+
+#ifdef LORA_LBT
+// a gateway ACK held on a busy channel is sent before the node gives up waiting for it
+static_assert((LBT_ACK_MAX_ATTEMPTS - 1) * LBT_BACKOFF_MAX < ACK_TIMEOUT, "LBT backoffs of a gateway ACK must end within ACK_TIMEOUT");
+static_assert(LBT_ACK_MAX_ATTEMPTS <= LBT_MAX_ATTEMPTS, "a gateway ACK gets at most as many channel checks as a downlink");
+#endif
+
+// downlink credits, updated by the task forwarding downlinks and the LoRa task
+static portMUX_TYPE credit_mux = portMUX_INITIALIZER_UNLOCKED;
+// pending lora settings change, posted by the system task and applied by the LoRa task
+static portMUX_TYPE config_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// rx LoRa packet queue, of PACKET_BUFFER pointers
+QueueHandle_t LoRaHomeGateway::rx_packet_queue = xQueueCreate(5, sizeof(PACKET_BUFFER *));
+// tx LoRa queues, one per traffic class, of PACKET_BUFFER pointers
+QueueHandle_t LoRaHomeGateway::tx_packet_queue[LH_TX_CLASS_COUNT] = {
+    xQueueCreate(5, sizeof(PACKET_BUFFER *)),
+    xQueueCreate(5, sizeof(PACKET_BUFFER *)),
+    xQueueCreate(5, sizeof(PACKET_BUFFER *))};
 
 // if running on Core 1 - same as per Arduino Framework
 // if running on Core 2 - leverage dual core architecture of ESP32
@@ -41,12 +64,87 @@ uint32_t LoRaHomeGateway::rx_counter = 0;
 uint32_t LoRaHomeGateway::tx_counter = 0;
 // err_counter - each time an error is triggered
 uint32_t LoRaHomeGateway::err_counter = 0;
+// downlink_lost_counter - each time a downlink is given up without node ACK
+uint32_t LoRaHomeGateway::downlink_lost_counter = 0;
+// duplicate_counter - each time an uplink already received is suppressed
+uint32_t LoRaHomeGateway::duplicate_counter = 0;
+// tx_deferred_counter - each time a transmission is deferred to comply with the duty cycle
+uint32_t LoRaHomeGateway::tx_deferred_counter = 0;
+// airtime (ms) left in the duty cycle window of the active channel, in scan mode the least left over the scan set
+uint32_t LoRaHomeGateway::airtime_budget = 0;
+// tx_drop_counter - each time a packet is dropped because the tx queue of its class is full
+uint32_t LoRaHomeGateway::tx_drop_counter[LH_TX_CLASS_COUNT] = {0};
+// lbt_busy_counter - each time a transmission is deferred because the channel is busy
+uint32_t LoRaHomeGateway::lbt_busy_counter = 0;
+// lbt_forced_counter - each time a packet is sent on a busy channel after LBT_MAX_ATTEMPTS (LBT_ACK_MAX_ATTEMPTS for a gateway ACK)
+uint32_t LoRaHomeGateway::lbt_forced_counter = 0;
+// scan_hit_counter - each time activity is detected on a channel of the scan set
+uint32_t LoRaHomeGateway::scan_hit_counter[LORA_SCAN_CHANNEL_COUNT] = {0};
+// channel_rx_counter - each time a valid frame is received on a channel of the scan set
+uint32_t LoRaHomeGateway::channel_rx_counter[LORA_SCAN_CHANNEL_COUNT] = {0};
+// downlink_counter - each time a downlink is received from the host
+uint32_t LoRaHomeGateway::downlink_counter = 0;
+// downlink_credit_limit - downlinks the host may have sent since boot, incremented each time a downlink leaves its tx queue
+uint32_t LoRaHomeGateway::downlink_credit_limit = DOWNLINK_CREDITS;
+// credit_overrun_counter - each time a downlink is received beyond the credit limit
+uint32_t LoRaHomeGateway::credit_overrun_counter = 0;
+// retune_us - time the transceiver did not listen during the last lora settings change
+uint32_t LoRaHomeGateway::retune_us = 0;
+// foreign_counter - each time a valid frame of another network reaches the MCU, per channel of the scan set
+uint32_t LoRaHomeGateway::foreign_counter[LORA_SCAN_CHANNEL_COUNT] = {0};
+// scan_miss_counter - each time a lock on channel activity ends without a valid frame, per channel of the scan set
+// frames dropped by the transceiver on their sync word are only seen here (scan mode), among noise and CRC errors
+uint32_t LoRaHomeGateway::scan_miss_counter[LORA_SCAN_CHANNEL_COUNT] = {0};
+// airtime (ms) left in the duty cycle window of the sub-band of each channel of the scan set
+uint32_t LoRaHomeGateway::channel_airtime_budget[LORA_SCAN_CHANNEL_COUNT] = {0};
+// sync word of the transceiver
+uint8_t LoRaHomeGateway::sync_word = LORA_SYNC_WORD_DEFAULT;
 // counter used inside Tx LoRaHomeFrame
 uint16_t LoRaHomeGateway::packet_id_counter = 0;
 // time stamp of the last packet received
 unsigned long LoRaHomeGateway::last_packet_ts = millis();
 // network id
 uint16_t LoRaHomeGateway::network_id = 0;
+// state of the LoRa transceiver, only updated by the LoRa task once enabled
+LH_RADIO_STATE LoRaHomeGateway::radio_state = LH_RADIO_IDLE;
+// time stamp of the start of the ongoing transmission or channel activity detection
+unsigned long LoRaHomeGateway::tx_start_ts = 0;
+// downlinks waiting for a node ACK, only accessed by the LoRa task
+LH_INFLIGHT_DOWNLINK LoRaHomeGateway::inflight[MAX_INFLIGHT_DOWNLINKS] = {};
+// in flight downlink being transmitted, NULL if none
+LH_INFLIGHT_DOWNLINK *LoRaHomeGateway::tx_inflight = NULL;
+// active lora configuration
+LORA_CONFIGURATION LoRaHomeGateway::lora_config = {};
+// time (ms) to wait before the duty cycle allows the deferred transmission, 0 if none
+uint32_t LoRaHomeGateway::tx_defer_ms = 0;
+// packet selected for transmission, waiting for the channel to be free, NULL if none
+PACKET_BUFFER *LoRaHomeGateway::tx_packet = NULL;
+// number of channel checks done for tx_packet
+uint8_t LoRaHomeGateway::lbt_attempts = 0;
+// time stamp of the next channel check after a random backoff
+unsigned long LoRaHomeGateway::lbt_retry_ts = 0;
+// frequency the transceiver is tuned on
+long LoRaHomeGateway::current_frequency = 0;
+// frequency tx_packet is sent on
+long LoRaHomeGateway::tx_frequency = 0;
+// index of the scanned channel in LORA_SCAN_CHANNELS
+uint8_t LoRaHomeGateway::scan_index = 0;
+// true while receiving on the channel activity was detected on
+bool LoRaHomeGateway::scan_locked = false;
+// time stamp of the activity detection
+unsigned long LoRaHomeGateway::scan_lock_ts = 0;
+// time (ms) to stay on the channel activity was detected on, time on air of the largest frame
+uint32_t LoRaHomeGateway::scan_lock_ms = 0;
+// time stamp (us) of the last DIO0 interrupt, RxDone when a packet is available
+volatile uint32_t LoRaHomeGateway::dio0_ts = 0;
+// radio events processed by the reactor task (SINGLE_REACTOR), false while disabled
+bool LoRaHomeGateway::enabled = false;
+// lora settings to apply once the transceiver is listening, valid if reconfigure_pending
+LORA_CONFIGURATION LoRaHomeGateway::pending_config = {};
+volatile bool LoRaHomeGateway::reconfigure_pending = false;
+// sync word to be updated to a new network id (LORA_SYNC_WORD_FILTER)
+volatile bool LoRaHomeGateway::sync_word_pending = false;
+unsigned long LoRaHomeGateway::reconfigure_ts = 0;
 
 /**
  * @brief Construct a new LoRaHomeGateway object
@@ -69,9 +167,14 @@ void LoRaHomeGateway::setup(LORA_CONFIGURATION *lc, uint16_t network_id)
   pinMode(LED_WHITE, OUTPUT);
   // set network id
   this->network_id = network_id;
+  this->lora_config = *lc;
+  // scan mode starts on the first channel of the scan set
+  current_frequency = (CH_SCAN == lc->channel) ? LORA_SCAN_CHANNELS[0] : lc->channel;
+  tx_frequency = current_frequency;
+  scan_lock_ms = duty_cycle_time_on_air(lc, LH_FRAME_MAX_SIZE);
   // setup LoRa transceiver module
   LoRa.setPins(SS, RST, DIO0);
-  while (!LoRa.begin(lc->channel))
+  while (!LoRa.begin(current_frequency))
   {
     delay(500);
   }
@@ -79,12 +182,79 @@ void LoRaHomeGateway::setup(LORA_CONFIGURATION *lc, uint16_t network_id)
   LoRa.setSpreadingFactor(lc->spreading_factor);
   LoRa.setSignalBandwidth(lc->bandwidth);
   LoRa.setCodingRate4(lc->coding_rate);
-  // Change sync word (0xF3) to match the receiver
-  // ranges from 0-0xFF
-  // LoRa.setSyncWord(LORA_SYNC_WORD);
+#ifdef LORA_DIO0_INTERRUPT
+  LoRa.onDio0(onDio0Rise);
+#endif
+#ifdef LORA_SYNC_WORD_FILTER
+  // frames of other networks dropped by the transceiver
+  sync_word = lora_home_sync_word(network_id);
+  LoRa.setSyncWord(sync_word);
+#endif
   LoRa.enableCrc();
 }
 
+/**
+ * @brief change the lora settings, without resetting the transceiver
+ * applied by the LoRa task once no transmission or channel check is ongoing, only the registers that changed are written
+ *
+ * @param lc lora configuration settings to be used
+ */
+void LoRaHomeGateway::reconfigure(LORA_CONFIGURATION *lc)
+{
+  portENTER_CRITICAL(&config_mux);
+  pending_config = *lc;
+  reconfigure_pending = true;
+  reconfigure_ts = millis();
+  portEXIT_CRITICAL(&config_mux);
+  notify();
+}
+
+/**
+ * @brief apply the pending lora settings and sync word, in the LoRa task
+ * an ongoing reception is lost, the transceiver listens again right away on the new settings
+ *
+ */
+void LoRaHomeGateway::applyConfig()
+{
+  portENTER_CRITICAL(&config_mux);
+  bool config = reconfigure_pending;
+  LORA_CONFIGURATION lc = pending_config;
+  unsigned long requested_ts = reconfigure_ts;
+  reconfigure_pending = false;
+  sync_word_pending = false;
+  portEXIT_CRITICAL(&config_mux);
+  int64_t start = esp_timer_get_time();
+  // registers written, the standby mode switch not counted
+  uint32_t writes = 0;
+  if (config)
+  {
+    lora_config = lc;
+    // scan mode starts on the first channel of the scan set
+    long frequency = (CH_SCAN == lc.channel) ? LORA_SCAN_CHANNELS[0] : lc.channel;
+    writes += LoRa.reconfigure(frequency, lc.spreading_factor, lc.bandwidth, lc.coding_rate);
+    current_frequency = frequency;
+    // a frame deferred by the LBT backoff keeps the channel of its recipient, on the new settings
+    tx_frequency = (NULL != tx_packet) ? txFrequency(LH_FRAME(tx_packet)) : frequency;
+    scan_lock_ms = duty_cycle_time_on_air(&lc, LH_FRAME_MAX_SIZE);
+  }
+  else
+  {
+    LoRa.idle();
+  }
+#ifdef LORA_SYNC_WORD_FILTER
+  uint32_t sync_word_writes = LoRa.registerWrites();
+  sync_word = lora_home_sync_word(network_id);
+  LoRa.setSyncWord(sync_word);
+  writes += LoRa.registerWrites() - sync_word_writes;
+#endif
+  if (LH_RADIO_IDLE != radio_state)
+  {
+    listen();
+  }
+  retune_us = (uint32_t)(esp_timer_get_time() - start);
+  log_ring_put(LOG_ID_RETUNE, retune_us, writes, millis() - requested_ts);
+}
+
 /**
  * @brief set the lora home network id
  *
@@ -93,57 +263,112 @@ void LoRaHomeGateway::setup(LORA_CONFIGURATION *lc, uint16_t network_id)
 void LoRaHomeGateway::setNetworkID(uint16_t network_id)
 {
   this->network_id = network_id;
+#ifdef LORA_SYNC_WORD_FILTER
+  // the sync word follows, written by the LoRa task
+  portENTER_CRITICAL(&config_mux);
+  sync_word_pending = true;
+  reconfigure_ts = millis();
+  portEXIT_CRITICAL(&config_mux);
+  notify();
+#endif
 }
 
 /**
- * @brief put the packet in the Tx Fifo
+ * @brief put the packet in the Tx Fifo of its class
+ * does not wait for the node ACK: the LoRa task keeps the packet in flight and retries if needed
+ * the downlink takes a credit, returned once it leaves the Tx Fifo or is dropped
  *
- * @param packet lora home packet
+ * @param packet packet buffer holding the lora home packet at PACKET_POOL_HEADROOM, handed over
+ * @return true if the packet was queued
+ * @return false if the Tx Fifo remained full
  */
-void LoRaHomeGateway::putPacket(uint8_t *packet)
+bool LoRaHomeGateway::putPacket(PACKET_BUFFER *packet)
 {
-  bool success = false;
-  uint8_t ackBuffer[LH_FRAME_ACK_SIZE];
-  uint8_t retry = 0;
-  LORA_HOME_PACKET *lora_packet = (LORA_HOME_PACKET *)packet;
-  lora_packet->crc16 = crc16_ccitt(packet, sizeof(LORA_HOME_PACKET_HEADER) + lora_packet->header.payloadSize);
-
-  uint8_t raw_packet[LH_FRAME_MAX_SIZE];
-  memcpy(raw_packet, packet, sizeof(LORA_HOME_PACKET_HEADER) + lora_packet->header.payloadSize);
-  memcpy(&raw_packet[sizeof(LORA_HOME_PACKET_HEADER) + lora_packet->header.payloadSize], &(lora_packet->crc16), 2);
-  // send the LoRaHome raw_packet and loop max retry if necessary
-  do
+  uint8_t *frame = LH_FRAME(packet);
+  LORA_HOME_PACKET *lora_packet = (LORA_HOME_PACKET *)frame;
+  uint8_t size = sizeof(LORA_HOME_PACKET_HEADER) + lora_packet->header.payloadSize;
+  portENTER_CRITICAL(&credit_mux);
+  downlink_counter++;
+  bool overrun = ((int32_t)(downlink_counter - downlink_credit_limit) > 0);
+  portEXIT_CRITICAL(&credit_mux);
+  if (overrun)
   {
-    xQueueSend(tx_packet_queue, raw_packet, 0);
-    BaseType_t anymsg = xQueueReceive(rx_ack_packet_queue, ackBuffer, pdMS_TO_TICKS(ACK_TIMEOUT));
-    if (pdTRUE == anymsg)
-    {
-      LORA_HOME_PACKET *ack;
-      ack = (LORA_HOME_PACKET *)ackBuffer;
-      if ((ack->header.nodeIdEmitter == lora_packet->header.nodeIdRecipient) && (ack->header.counter == lora_packet->header.counter))
-      {
-        success = true;
-      }
-    }
-    retry++;
-    // loop if ack not received
-  } while ((false == success) && (retry < MAX_RETRY_NO_VALID_ACK));
+    credit_overrun_counter++;
+    log_ring_put(LOG_ID_CREDIT_OVERRUN, downlink_counter, downlink_credit_limit);
+  }
+  log_ring_put(LOG_ID_DOWNLINK, lora_packet->header.nodeIdRecipient, lora_packet->header.counter, size);
+  if ((size + LH_FRAME_FOOTER_SIZE) > LH_FRAME_MAX_SIZE)
+  {
+    err_counter++;
+    packet_pool_release(packet);
+    returnCredit();
+    return false;
+  }
+  // append the crc right after the payload, in place
+  uint16_t crc16 = crc16_ccitt(frame, size);
+  memcpy(&frame[size], &crc16, LH_FRAME_FOOTER_SIZE);
+  LH_TX_CLASS tx_class = txClass(packet);
+#ifdef SINGLE_REACTOR
+  // the reactor drains the tx queues, it waits for room before calling
+  TickType_t wait = 0;
+#else
+  // wait at most the time a single downlink used to block for its ACK
+  TickType_t wait = pdMS_TO_TICKS(ACK_TIMEOUT * MAX_RETRY_NO_VALID_ACK);
+#endif
+  if (pdTRUE != xQueueSend(tx_packet_queue[tx_class], &packet, wait))
+  {
+    tx_drop_counter[tx_class]++;
+    log_ring_put(LOG_ID_TX_DROP, tx_class);
+    packet_pool_release(packet);
+    returnCredit();
+    return false;
+  }
+  notify();
+  return true;
+}
+
+/**
+ * @brief return the credit of a downlink, and advertise it to the host
+ *
+ */
+void LoRaHomeGateway::returnCredit()
+{
+  portENTER_CRITICAL(&credit_mux);
+  downlink_credit_limit++;
+  portEXIT_CRITICAL(&credit_mux);
+  DONGLE_CREDITS_PACKET_PAYLOAD credits;
+  lhg.getCredits(&credits);
+  // if the uart tx queue is full, the next credits packet or heartbeat carries the limit
+  serial_api_send_sys_payload(TYPE_SYS_INFO_CREDITS, &credits, sizeof(DONGLE_CREDITS_PACKET_PAYLOAD));
+}
+
+/**
+ * @brief get the downlink flow control state
+ *
+ * @param credits used to return downlinks received, credit limit and drop counters
+ */
+void LoRaHomeGateway::getCredits(DONGLE_CREDITS_PACKET_PAYLOAD *credits)
+{
+  portENTER_CRITICAL(&credit_mux);
+  credits->downlink_counter = downlink_counter;
+  credits->credit_limit = downlink_credit_limit;
+  portEXIT_CRITICAL(&credit_mux);
+  credits->downlink_drop_counter = tx_drop_counter[LH_TX_CLASS_DOWNLINK_ACK_REQ] + tx_drop_counter[LH_TX_CLASS_DOWNLINK_NO_ACK];
+  credits->uart_rx_drop_counter = uart_rx_drop_counter;
 }
 
 /**
  * @brief pop the LoRaHomeFrame if any available in the Rx message queue
  *
- * @param rxBuffer the lora home packet
+ * @param packet pointer used to return the packet buffer, lora home packet at PACKET_POOL_HEADROOM, to be released by the caller
+ * @param wait max time to wait for a message
  * @return true if a message was available
  * @return false if no message available
  */
-bool LoRaHomeGateway::popLoRaHomePayload(uint8_t *rxBuffer)
+bool LoRaHomeGateway::popLoRaHomePayload(PACKET_BUFFER **packet, TickType_t wait)
 {
-  // uint8_t rxBuffer[LH_FRAME_MAX_SIZE];
-
   // any LoRa message in the queue?
-  // enter critical section to retrieve data in the queue
-  BaseType_t anymsg = xQueueReceive(rx_packet_queue, rxBuffer, 0);
+  BaseType_t anymsg = xQueueReceive(rx_packet_queue, packet, wait);
   if (pdTRUE == anymsg)
   {
     last_packet_ts = millis();
@@ -160,15 +385,64 @@ bool LoRaHomeGateway::popLoRaHomePayload(uint8_t *rxBuffer)
  */
 void LoRaHomeGateway::putAck(uint8_t nodeIdRecipient, uint16_t counter)
 {
-  LORA_HOME_ACK ack_packet = {0};
-  ack_packet.header.counter = counter;
-  ack_packet.header.messageType = LH_MSG_TYPE_GW_ACK;
-  ack_packet.header.networkID = this->network_id;
-  ack_packet.header.nodeIdEmitter = LH_NODE_ID_GATEWAY;
-  ack_packet.header.nodeIdRecipient = nodeIdRecipient;
-  ack_packet.header.payloadSize = 0;
-  ack_packet.crc16 = crc16_ccitt((uint8_t *)&ack_packet, sizeof(LORA_HOME_PACKET_HEADER));
-  xQueueSend(tx_packet_queue, &ack_packet, 0);
+  PACKET_BUFFER *packet = packet_pool_alloc();
+  if (NULL == packet)
+  {
+    tx_drop_counter[LH_TX_CLASS_GW_ACK]++;
+    log_ring_put(LOG_ID_TX_DROP, LH_TX_CLASS_GW_ACK);
+    return;
+  }
+  LORA_HOME_ACK *ack_packet = (LORA_HOME_ACK *)LH_FRAME(packet);
+  memset(ack_packet, 0, sizeof(LORA_HOME_ACK));
+  ack_packet->header.counter = counter;
+  ack_packet->header.messageType = LH_MSG_TYPE_GW_ACK;
+  ack_packet->header.networkID = this->network_id;
+  ack_packet->header.nodeIdEmitter = LH_NODE_ID_GATEWAY;
+  ack_packet->header.nodeIdRecipient = nodeIdRecipient;
+  ack_packet->header.payloadSize = 0;
+  ack_packet->crc16 = crc16_ccitt((uint8_t *)ack_packet, sizeof(LORA_HOME_PACKET_HEADER));
+  if (pdTRUE != xQueueSend(tx_packet_queue[LH_TX_CLASS_GW_ACK], &packet, 0))
+  {
+    tx_drop_counter[LH_TX_CLASS_GW_ACK]++;
+    log_ring_put(LOG_ID_TX_DROP, LH_TX_CLASS_GW_ACK);
+    packet_pool_release(packet);
+  }
+  notify();
+}
+
+/**
+ * @brief get the traffic class of a downlink
+ *
+ * @param packet packet buffer holding the lora home packet at PACKET_POOL_HEADROOM
+ * @return LH_TX_CLASS class, by message type
+ */
+LH_TX_CLASS LoRaHomeGateway::txClass(PACKET_BUFFER *packet)
+{
+  LORA_HOME_PACKET *lora_packet = (LORA_HOME_PACKET *)LH_FRAME(packet);
+  return (LH_MSG_TYPE_GW_MSG_ACK == lora_packet->header.messageType) ? LH_TX_CLASS_DOWNLINK_ACK_REQ : LH_TX_CLASS_DOWNLINK_NO_ACK;
+}
+
+/**
+ * @brief check whether the Tx Fifo a downlink goes to is full
+ *
+ * @param packet packet buffer holding the lora home packet at PACKET_POOL_HEADROOM
+ * @return true if putPacket would have to wait
+ * @return false if there is room
+ */
+bool LoRaHomeGateway::isTxQueueFull(PACKET_BUFFER *packet)
+{
+  return 0 == uxQueueSpacesAvailable(tx_packet_queue[txClass(packet)]);
+}
+
+/**
+ * @brief get the number of packets waiting in the Tx Fifo of a class
+ *
+ * @param tx_class traffic class
+ * @return uint8_t number of packets queued
+ */
+uint8_t LoRaHomeGateway::getTxQueueDepth(LH_TX_CLASS tx_class)
+{
+  return uxQueueMessagesWaiting(tx_packet_queue[tx_class]);
 }
 
 /**
@@ -177,25 +451,31 @@ void LoRaHomeGateway::putAck(uint8_t nodeIdRecipient, uint16_t counter)
  */
 void LoRaHomeGateway::enable()
 {
+#ifdef SINGLE_REACTOR
+  // radio events are processed by the reactor task, enable is called before it starts or from it
+  enabled = true;
+  this->listen();
+#else
   if (NULL == task_lora)
   {
     // start LoRa Task on core 0 (not used by arduino framework)
     xTaskCreatePinnedToCore(
         taskRxTx,   /* Task function. */
         "LoRa",     /* name of task. */
-        10000,      /* 10kBytes Stack size of task */
+        LORA_TASK_STACK_SIZE, /* 10kBytes Stack size of task */
         NULL,       /* (void *)this->onReceive, parameter of the task */
         1,          /* priority of the task */
         &task_lora, /* Task handler to keep track of created task */
         lora_code); /* pin task to core 0, default Arduino setup and main running on core 1 */
 
     // set in rx mode.
-    this->rxMode();
+    this->listen();
   }
   else
   {
     vTaskResume(task_lora);
   }
+#endif
 }
 
 /**
@@ -204,7 +484,11 @@ void LoRaHomeGateway::enable()
  */
 void LoRaHomeGateway::disable()
 {
+#ifdef SINGLE_REACTOR
+  enabled = false;
+#else
   vTaskSuspend(task_lora);
+#endif
 }
 
 /**
@@ -218,6 +502,75 @@ void LoRaHomeGateway::rxMode()
   LoRa.disableInvertIQ(); // normal mode
   // put the radio into receive mode
   LoRa.receive();
+  radio_state = LH_RADIO_RX;
+}
+
+/**
+ * @brief get back to listening: rx mode on the configured channel, or scanning the channels of the scan set
+ *
+ */
+void LoRaHomeGateway::listen()
+{
+  if (CH_SCAN != lora_config.channel)
+  {
+    rxMode();
+    return;
+  }
+  LoRa.disableInvertIQ(); // normal mode
+  scan_locked = false;
+  scanNext();
+}
+
+/**
+ * @brief look for LoRa activity (Channel Activity Detection) on the next channel of the scan set
+ *
+ */
+void LoRaHomeGateway::scanNext()
+{
+  scan_index = (scan_index + 1) % LORA_SCAN_CHANNEL_COUNT;
+  tune(LORA_SCAN_CHANNELS[scan_index]);
+  LoRa.channelActivityDetection();
+  tx_start_ts = millis();
+  radio_state = LH_RADIO_SCAN;
+}
+
+/**
+ * @brief tune the transceiver, left untouched if already on the frequency
+ *
+ * @param frequency frequency in Hz
+ */
+void LoRaHomeGateway::tune(long frequency)
+{
+  if (frequency == current_frequency)
+  {
+    return;
+  }
+  // frequency can only be changed in standby
+  LoRa.idle();
+  LoRa.setFrequency(frequency);
+  current_frequency = frequency;
+}
+
+/**
+ * @brief get the frequency to send a frame on
+ * in scan mode, the channel the recipient was last heard on, LORA_SCAN_DEFAULT_CHANNEL if unknown or broadcast
+ *
+ * @param frame lora home frame
+ * @return long frequency in Hz
+ */
+long LoRaHomeGateway::txFrequency(const uint8_t *frame)
+{
+  if (CH_SCAN != lora_config.channel)
+  {
+    return lora_config.channel;
+  }
+  NODE_TABLE_ENTRY entry;
+  const LORA_HOME_PACKET *packet = (const LORA_HOME_PACKET *)frame;
+  if ((LH_NODE_ID_BROADCAST != packet->header.nodeIdRecipient) && node_table_get(packet->header.nodeIdRecipient, &entry) && (CH_NONE != entry.channel))
+  {
+    return entry.channel;
+  }
+  return LORA_SCAN_DEFAULT_CHANNEL;
 }
 
 /**
@@ -234,43 +587,85 @@ void LoRaHomeGateway::txMode()
 /**
  * @brief LoRa callback function when packets are available
  * Sort out the incoming LoRa messages in the right Queue for later processing (message, ack)
+ * the frame is read once into a packet buffer, handed over by pointer up to the UART
  * @param packet_size number of bytes available
  */
 void LoRaHomeGateway::onReceive(int packet_size)
 {
+  uint32_t start = ESP.getCycleCount();
   // increment rx_counter - new message received
   rx_counter++;
-  uint8_t rxMessage[LH_FRAME_MAX_SIZE];
   if ((packet_size > LH_FRAME_MAX_SIZE) || (packet_size < LH_FRAME_MIN_SIZE))
   {
     err_counter++;
+    log_ring_put(LOG_ID_RX_ERROR, packet_size, LOG_RX_ERROR_SIZE);
     return;
   }
-  for (int i = 0; i < packet_size; i++)
+  PACKET_BUFFER *rx_packet = packet_pool_alloc();
+  if (NULL == rx_packet)
   {
-    rxMessage[i] = (uint8_t)LoRa.read();
+    err_counter++;
+    log_ring_put(LOG_ID_RX_ERROR, packet_size, LOG_RX_ERROR_NO_BUFFER);
+    return;
   }
-
-  if (!checkCRC(rxMessage, packet_size))
+  uint8_t *rxMessage = LH_FRAME(rx_packet);
+  if ((LoRa.readFifo(rxMessage, packet_size) != (size_t)packet_size) || !checkCRC(rxMessage, packet_size))
   {
     err_counter++;
+    log_ring_put(LOG_ID_RX_ERROR, packet_size, LOG_RX_ERROR_CRC);
+    packet_pool_release(rx_packet);
     return;
   }
-
   LORA_HOME_PACKET *packet;
   packet = (LORA_HOME_PACKET *)&rxMessage[0];
 
+  // not filtered by the sync word, see foreign_counter
+  bool foreign = (packet->header.networkID != network_id);
+  for (uint8_t i = 0; i < LORA_SCAN_CHANNEL_COUNT; i++)
+  {
+    if (LORA_SCAN_CHANNELS[i] == current_frequency)
+    {
+      channel_rx_counter[i]++;
+      if (foreign)
+      {
+        foreign_counter[i]++;
+      }
+    }
+  }
+
   if ((packet->header.networkID == network_id) && ((packet->header.nodeIdRecipient == LH_NODE_ID_GATEWAY) || (packet->header.nodeIdRecipient == LH_NODE_ID_BROADCAST)))
   {
+    node_table_put_link(packet->header.nodeIdEmitter, LoRa.packetRssi(), (int8_t)(LoRa.packetSnr() * 4), (Lora_Frequency_Channel)current_frequency);
+    // tells a retransmission from another uplink with the same counter, after a node restart
+    uint16_t rx_crc16;
+    memcpy(&rx_crc16, &rxMessage[packet_size - LH_FRAME_FOOTER_SIZE], LH_FRAME_FOOTER_SIZE);
     // analyse the message type (ack or standard)
     switch (packet->header.messageType)
     {
     case LH_MSG_TYPE_NODE_MSG_ACK_REQ:
+      // ACK duplicates as well, the previous ACK was likely lost
       lhg.putAck(packet->header.nodeIdEmitter, packet->header.counter);
-      xQueueSend(rx_packet_queue, rxMessage, 0);
-      break;
+      // fall through
     case LH_MSG_TYPE_NODE_MSG_NO_ACK_REQ:
-      xQueueSend(rx_packet_queue, rxMessage, 0);
+      if (node_table_is_duplicate(packet->header.nodeIdEmitter, packet->header.counter, rx_crc16))
+      {
+        duplicate_counter++;
+      }
+      else
+      {
+        rx_packet->length = packet_size;
+        rx_packet->cycles = ESP.getCycleCount() - start;
+#ifdef LORA_DIO0_INTERRUPT
+        rx_packet->rx_ts = dio0_ts;
+#else
+        rx_packet->rx_ts = (uint32_t)esp_timer_get_time();
+#endif
+        if (pdTRUE == xQueueSend(rx_packet_queue, &rx_packet, 0))
+        {
+          // handed over
+          rx_packet = NULL;
+        }
+      }
       break;
     case LH_MSG_TYPE_NODE_ACK:
       if (packet_size != LH_FRAME_ACK_SIZE)
@@ -279,7 +674,7 @@ void LoRaHomeGateway::onReceive(int packet_size)
       }
       else
       {
-        xQueueSend(rx_ack_packet_queue, rxMessage, 0);
+        ackInflight(packet->header.nodeIdEmitter, packet->header.counter);
       }
       break;
     case LH_MSG_TYPE_GW_ACK:
@@ -288,85 +683,522 @@ void LoRaHomeGateway::onReceive(int packet_size)
     default:
       // unknown message type. Shall be an error
       err_counter++;
+      log_ring_put(LOG_ID_RX_ERROR, packet_size, LOG_RX_ERROR_MSG_TYPE);
       break;
     }
   }
+  if (NULL != rx_packet)
+  {
+    packet_pool_release(rx_packet);
+  }
 }
 
 /**
- * @brief send a packet over Lora
+ * @brief start sending the next packet over Lora
+ * strict priority: gateway ACKs, in flight downlinks to be retransmitted, downlinks requesting an ACK, best effort downlinks
+ * transmission is asynchronous, completion is handled by onTxDone
  *
  */
 void LoRaHomeGateway::send()
 {
-  uint8_t txBuffer[LH_FRAME_MAX_SIZE];
-  BaseType_t anymsg = xQueueReceive(tx_packet_queue, txBuffer, 0);
-  if (pdTRUE == anymsg)
+  tx_defer_ms = 0;
+  if (sendQueued(LH_TX_CLASS_GW_ACK) || sendInflight() || sendQueued(LH_TX_CLASS_DOWNLINK_ACK_REQ))
   {
-    tx_counter++;
-    uint8_t size = LH_FRAME_HEADER_SIZE + txBuffer[LH_PACKET_INDEX_PAYLOAD_SIZE] + LH_FRAME_FOOTER_SIZE;
-    txMode();
-    while (LoRa.beginPacket() == 0)
-      ;
-    // char log[256] = "\0";
-    for (uint8_t i = 0; i < size; i++)
+    return;
+  }
+  sendQueued(LH_TX_CLASS_DOWNLINK_NO_ACK);
+}
+
+/**
+ * @brief start retransmitting an in flight downlink if any is pending
+ *
+ * @return true if a transmission was started or deferred
+ * @return false nothing to retransmit
+ */
+bool LoRaHomeGateway::sendInflight()
+{
+  for (uint8_t i = 0; i < MAX_INFLIGHT_DOWNLINKS; i++)
+  {
+    if (LH_INFLIGHT_TX_PENDING == inflight[i].state)
     {
-      LoRa.write(txBuffer[i]);
-      // sprintf(log + strlen(log), "%02X:", txBuffer[i]);
+      if (startTx(inflight[i].packet))
+      {
+        inflight[i].state = LH_INFLIGHT_TX;
+        tx_inflight = &inflight[i];
+      }
+      return true;
     }
-    LoRa.endPacket();
-    rxMode();
-    // serial_api_send_log_message(log);
   }
+  return false;
 }
 
-void LoRaHomeGateway::taskRxTx(void *pvParameters)
+/**
+ * @brief start sending the packet at the head of the Tx Fifo of a class if any
+ * downlinks requesting an ACK are moved to a free in flight slot, others are sent once
+ *
+ * @param tx_class traffic class
+ * @return true if a transmission was started or deferred
+ * @return false nothing to send, or no in flight slot available
+ */
+bool LoRaHomeGateway::sendQueued(LH_TX_CLASS tx_class)
 {
-  int packet_length = 0;
-  while (true)
+  PACKET_BUFFER *packet;
+  if (LH_TX_CLASS_DOWNLINK_ACK_REQ != tx_class)
   {
-    packet_length = LoRa.availablePacket();
-    if (packet_length > 0)
+    if (pdTRUE != xQueuePeek(tx_packet_queue[tx_class], &packet, 0))
     {
-      onReceive(packet_length);
+      return false;
     }
-    // call a send task
-    send();
-    // give the opportunity to the IDLE task to run, and so avoid the TaskWatchDog timer to trigger a reset
-    vTaskDelay(10 / portTICK_PERIOD_MS);
+    if (startTx(packet))
+    {
+      // the transmission holds its own reference
+      xQueueReceive(tx_packet_queue[tx_class], &packet, 0);
+      packet_pool_release(packet);
+      if (LH_TX_CLASS_GW_ACK != tx_class)
+      {
+        returnCredit();
+      }
+    }
+    return true;
   }
+  for (uint8_t i = 0; i < MAX_INFLIGHT_DOWNLINKS; i++)
+  {
+    if (LH_INFLIGHT_FREE == inflight[i].state)
+    {
+      if (pdTRUE != xQueuePeek(tx_packet_queue[tx_class], &packet, 0))
+      {
+        return false;
+      }
+      if (startTx(packet))
+      {
+        // the reference of the queue moves to the in flight slot
+        xQueueReceive(tx_packet_queue[tx_class], &inflight[i].packet, 0);
+        inflight[i].state = LH_INFLIGHT_TX;
+        inflight[i].tx_count = 0;
+        tx_inflight = &inflight[i];
+        returnCredit();
+      }
+      return true;
+    }
+  }
+  // all slots in flight, keep the packet in the Tx Fifo until an ACK or a timeout frees one
+  return false;
 }
 
 /**
- * @brief compute CRC16 ccitt
+ * @brief select the packet for transmission
+ * the packet is deferred (not selected) if its time on air exceeds the duty cycle budget left
+ * with LORA_LBT, the channel is checked first, else the transmission starts right away
  *
- * @param data data to be used to compute CRC16
- * @param data_len length of the buffer
- * @return uint16_t
+ * @param packet packet buffer holding the lora home frame, header + payload + crc, referenced until transmitted
+ * @return true if the packet was selected
+ * @return false if deferred, tx_defer_ms is set to the time to wait
  */
-uint16_t LoRaHomeGateway::crc16_ccitt(const uint8_t *data, unsigned int data_len)
+bool LoRaHomeGateway::startTx(PACKET_BUFFER *packet)
 {
-  uint16_t crc = 0xFFFF;
+  const uint8_t *frame = LH_FRAME(packet);
+  uint8_t size = LH_FRAME_HEADER_SIZE + frame[LH_PACKET_INDEX_PAYLOAD_SIZE] + LH_FRAME_FOOTER_SIZE;
+  tx_frequency = txFrequency(frame);
+  tx_defer_ms = duty_cycle_wait(tx_frequency, duty_cycle_time_on_air(&lora_config, size));
+  if (0 != tx_defer_ms)
+  {
+    tx_deferred_counter++;
+    return false;
+  }
+  packet_pool_ref(packet);
+  tx_packet = packet;
+#ifdef LORA_LBT
+  lbt_attempts = 0;
+  listenBeforeTalk();
+#else
+  transmit();
+#endif
+  return true;
+}
+
+/**
+ * @brief write the selected frame in the transceiver and start an asynchronous transmission
+ *
+ */
+void LoRaHomeGateway::transmit()
+{
+  const uint8_t *tx_frame = LH_FRAME(tx_packet);
+  uint8_t size = LH_FRAME_HEADER_SIZE + tx_frame[LH_PACKET_INDEX_PAYLOAD_SIZE] + LH_FRAME_FOOTER_SIZE;
+  duty_cycle_register(tx_frequency, duty_cycle_time_on_air(&lora_config, size));
+  tune(tx_frequency);
+  txMode();
+  LoRa.beginPacket();
+  LoRa.writeFifo(tx_frame, size);
+  LoRa.endPacket(true);
+  packet_pool_release(tx_packet);
+  tx_packet = NULL;
+  tx_start_ts = millis();
+  radio_state = LH_RADIO_TX;
+}
+
+/**
+ * @brief listen before talk - check the channel before transmitting the selected frame
+ * the channel is busy if a frame is being received, else a Channel Activity Detection is started
+ *
+ */
+void LoRaHomeGateway::listenBeforeTalk()
+{
+  lbt_attempts++;
+  tune(tx_frequency);
+  if (LoRa.isReceiving())
+  {
+    onCadDone(true);
+    return;
+  }
+  LoRa.channelActivityDetection();
+  tx_start_ts = millis();
+  radio_state = LH_RADIO_CAD;
+}
+
+/**
+ * @brief CadDone event - transmit if the channel is free, else back to rx mode for a random backoff
+ * transmit anyway after LBT_MAX_ATTEMPTS, after LBT_ACK_MAX_ATTEMPTS for a gateway ACK not to hold it beyond ACK_TIMEOUT
+ *
+ * @param detected true if LoRa activity was detected on the channel
+ */
+void LoRaHomeGateway::onCadDone(bool detected)
+{
+  if (!detected)
+  {
+    transmit();
+    return;
+  }
+  const LORA_HOME_PACKET *packet = (const LORA_HOME_PACKET *)LH_FRAME(tx_packet);
+  uint8_t max_attempts = (LH_MSG_TYPE_GW_ACK == packet->header.messageType) ? LBT_ACK_MAX_ATTEMPTS : LBT_MAX_ATTEMPTS;
+  if (lbt_attempts >= max_attempts)
+  {
+    lbt_forced_counter++;
+    log_ring_put(LOG_ID_LBT_FORCED, lbt_attempts);
+    transmit();
+    return;
+  }
+  lbt_busy_counter++;
+  lbt_retry_ts = millis() + LBT_BACKOFF_MIN + esp_random() % (LBT_BACKOFF_MAX - LBT_BACKOFF_MIN + 1);
+  listen();
+}
+
+/**
+ * @brief TxDone event - transmission over, get back to rx mode
+ * start the ACK timer if the frame was an in flight downlink
+ *
+ * @param done false if TxDone never came
+ */
+void LoRaHomeGateway::onTxDone(bool done)
+{
+  if (done)
+  {
+    tx_counter++;
+  }
+  else
+  {
+    err_counter++;
+  }
+  if (NULL != tx_inflight)
+  {
+    tx_inflight->tx_count++;
+    tx_inflight->ack_deadline = millis() + ACK_TIMEOUT;
+    tx_inflight->state = LH_INFLIGHT_WAIT_ACK;
+    tx_inflight = NULL;
+  }
+  listen();
+}
+
+/**
+ * @brief node ACK received, release the matching in flight downlink
+ *
+ * @param nodeIdEmitter node sending the ACK
+ * @param counter counter of the acknowledged downlink
+ */
+void LoRaHomeGateway::ackInflight(uint8_t nodeIdEmitter, uint16_t counter)
+{
+  for (uint8_t i = 0; i < MAX_INFLIGHT_DOWNLINKS; i++)
+  {
+    if ((LH_INFLIGHT_FREE == inflight[i].state) || (LH_INFLIGHT_TX == inflight[i].state))
+    {
+      continue;
+    }
+    LORA_HOME_PACKET *packet = (LORA_HOME_PACKET *)LH_FRAME(inflight[i].packet);
+    if ((packet->header.nodeIdRecipient == nodeIdEmitter) && (packet->header.counter == counter))
+    {
+      freeInflight(&inflight[i]);
+      return;
+    }
+  }
+}
+
+/**
+ * @brief free an in flight slot, and release its packet buffer
+ *
+ * @param downlink in flight downlink
+ */
+void LoRaHomeGateway::freeInflight(LH_INFLIGHT_DOWNLINK *downlink)
+{
+  downlink->state = LH_INFLIGHT_FREE;
+  packet_pool_release(downlink->packet);
+  downlink->packet = NULL;
+}
+
+/**
+ * @brief check ACK timers of in flight downlinks
+ * schedule a retransmission, or give up after MAX_RETRY_NO_VALID_ACK transmissions
+ *
+ * @return TickType_t time to wait until the next ACK timer expires
+ */
+TickType_t LoRaHomeGateway::checkInflight()
+{
+  unsigned long now = millis();
+  unsigned long wait = LORA_TASK_WAIT_TIMEOUT;
+  for (uint8_t i = 0; i < MAX_INFLIGHT_DOWNLINKS; i++)
+  {
+    if (LH_INFLIGHT_WAIT_ACK != inflight[i].state)
+    {
+      continue;
+    }
+    long remaining = (long)(inflight[i].ack_deadline - now);
+    if (remaining > 0)
+    {
+      if ((unsigned long)remaining < wait)
+      {
+        wait = remaining;
+      }
+    }
+    else if (inflight[i].tx_count < MAX_RETRY_NO_VALID_ACK)
+    {
+      inflight[i].state = LH_INFLIGHT_TX_PENDING;
+    }
+    else
+    {
+      LORA_HOME_PACKET *lost = (LORA_HOME_PACKET *)LH_FRAME(inflight[i].packet);
+      log_ring_put(LOG_ID_DOWNLINK_LOST, lost->header.nodeIdRecipient, lost->header.counter, inflight[i].tx_count);
+      freeInflight(&inflight[i]);
+      downlink_lost_counter++;
+    }
+  }
+  return pdMS_TO_TICKS(wait);
+}
+
+/**
+ * @brief DIO0 interrupt handler (RxDone, CadDone or TxDone)
+ * no SPI access from interrupt context, simply wake up the LoRa task (or the reactor)
+ */
+void IRAM_ATTR LoRaHomeGateway::onDio0Rise()
+{
+  BaseType_t higher_priority_task_woken = pdFALSE;
+  dio0_ts = (uint32_t)esp_timer_get_time();
+#ifdef SINGLE_REACTOR
+  reactor_post_from_isr(REACTOR_EVENT_RADIO, &higher_priority_task_woken);
+#else
+  if (NULL != task_lora)
+  {
+    vTaskNotifyGiveFromISR(task_lora, &higher_priority_task_woken);
+  }
+#endif
+  portYIELD_FROM_ISR(higher_priority_task_woken);
+}
 
-  if (data_len == 0)
-    return 0;
+/**
+ * @brief wake up the LoRa task (or the reactor), e.g. when a packet is pushed in the tx queue
+ *
+ */
+void LoRaHomeGateway::notify()
+{
+#if defined(SINGLE_REACTOR)
+  reactor_post(REACTOR_EVENT_RADIO);
+#elif defined(LORA_DIO0_INTERRUPT)
+  if (NULL != task_lora)
+  {
+    xTaskNotifyGive(task_lora);
+  }
+#endif
+}
 
-  for (unsigned int i = 0; i < data_len; ++i)
+/**
+ * @brief serve the transmission side when the transceiver is listening
+ * check the channel again once the LBT backoff is over, else start sending the next queued packet if any
+ *
+ * @param wait time the LoRa task is going to wait
+ * @return TickType_t time to wait, shortened to the backoff or duty cycle deferral
+ */
+TickType_t LoRaHomeGateway::serveTx(TickType_t wait)
+{
+  if (NULL != tx_packet)
+  {
+    // channel was busy, check it again after the backoff
+    long backoff = (long)(lbt_retry_ts - millis());
+    if (backoff <= 0)
+    {
+      listenBeforeTalk();
+    }
+    else if (pdMS_TO_TICKS(backoff) < wait)
+    {
+      wait = pdMS_TO_TICKS(backoff);
+    }
+  }
+  else
   {
-    uint16_t dbyte = data[i];
-    crc ^= dbyte << 8;
+    // start sending the next packet if any
+    send();
+    if ((0 != tx_defer_ms) && (pdMS_TO_TICKS(tx_defer_ms) < wait))
+    {
+      wait = pdMS_TO_TICKS(tx_defer_ms);
+    }
+  }
+  return wait;
+}
 
-    for (unsigned char j = 0; j < 8; ++j)
+/**
+ * @brief LoRa transceiver state machine, one step per event
+ * - TX: wait for TxDone (or timeout), then get back to RX
+ * - CAD: wait for CadDone, then transmit or get back to RX for a random backoff
+ * - SCAN: wait for CadDone, lock on the channel in RX if activity was detected, else serve TX and scan the next channel
+ * - RX: read received packets, start sending the next queued packet if any
+ * in scan mode, RX stays locked on the channel until a packet is received or the largest frame had time to end
+ *
+ * @return TickType_t time to wait for the next event before calling again, 10ms without LORA_DIO0_INTERRUPT
+ */
+TickType_t LoRaHomeGateway::process()
+{
+  int packet_length = 0;
+  TickType_t wait = pdMS_TO_TICKS(LORA_TASK_WAIT_TIMEOUT);
+#ifdef SINGLE_REACTOR
+  if (!enabled)
+  {
+    return wait;
+  }
+#endif
+  if (LH_RADIO_TX == radio_state)
+  {
+    if (LoRa.txDone())
+    {
+      onTxDone();
+    }
+    else if ((millis() - tx_start_ts) > LORA_TX_TIMEOUT)
+    {
+      // TxDone never came, handled as a lost transmission
+      log_ring_put(LOG_ID_TX_TIMEOUT, millis() - tx_start_ts);
+      onTxDone(false);
+    }
+  }
+  if (LH_RADIO_CAD == radio_state)
+  {
+    int cad = LoRa.cadResult();
+    if (cad >= 0)
     {
-      uint16_t mix = crc & 0x8000;
-      crc = (crc << 1);
-      if (mix)
+      onCadDone(1 == cad);
+    }
+    else if ((millis() - tx_start_ts) > LORA_CAD_TIMEOUT)
+    {
+      // CadDone never came, do not hold the frame
+      onCadDone(false);
+    }
+  }
+  if ((reconfigure_pending || sync_word_pending) && (LH_RADIO_TX != radio_state) && (LH_RADIO_CAD != radio_state))
+  {
+    applyConfig();
+  }
+  wait = checkInflight();
+  if (LH_RADIO_SCAN == radio_state)
+  {
+    int cad = LoRa.cadResult();
+    if (1 == cad)
+    {
+      // preamble on the channel, lock on it to receive the frame
+      scan_hit_counter[scan_index]++;
+      rxMode();
+      scan_locked = true;
+      scan_lock_ts = millis();
+    }
+    else if ((0 == cad) || ((millis() - tx_start_ts) > LORA_CAD_TIMEOUT))
+    {
+      wait = serveTx(wait);
+      if (LH_RADIO_SCAN == radio_state)
+      {
+        scanNext();
+      }
+    }
+  }
+  if (LH_RADIO_RX == radio_state)
+  {
+    packet_length = LoRa.availablePacket();
+    if (packet_length > 0)
+    {
+      onReceive(packet_length);
+      scan_locked = false;
+    }
+    if (scan_locked)
+    {
+      long lock = (long)(scan_lock_ts + scan_lock_ms - millis());
+      if (lock <= 0)
       {
-        crc = crc ^ 0x1021;
+        if (!LoRa.isReceiving())
+        {
+          // no frame came, it was received with errors, or dropped on its sync word
+          scan_miss_counter[scan_index]++;
+          scan_locked = false;
+        }
+        // frame still being received, check again shortly
+        lock = LORA_SCAN_POLL;
+      }
+      if (scan_locked && (pdMS_TO_TICKS(lock) < wait))
+      {
+        wait = pdMS_TO_TICKS(lock);
+      }
+    }
+    if (!scan_locked)
+    {
+      wait = serveTx(wait);
+      if ((CH_SCAN == lora_config.channel) && (LH_RADIO_RX == radio_state))
+      {
+        // LBT backoff, or nothing to send
+        listen();
       }
     }
   }
-  return crc;
+  // in scan mode the host cannot tell the channel of a downlink, the sub-band with the least airtime left paces them all
+  airtime_budget = (CH_SCAN == lora_config.channel) ? UINT32_MAX : duty_cycle_remaining(lora_config.channel);
+  for (uint8_t i = 0; i < LORA_SCAN_CHANNEL_COUNT; i++)
+  {
+    channel_airtime_budget[i] = duty_cycle_remaining(LORA_SCAN_CHANNELS[i]);
+    if ((CH_SCAN == lora_config.channel) && (channel_airtime_budget[i] < airtime_budget))
+    {
+      airtime_budget = channel_airtime_budget[i];
+    }
+  }
+#ifndef LORA_DIO0_INTERRUPT
+  // transceiver polled every 10ms
+  wait = pdMS_TO_TICKS(10);
+#endif
+  return wait;
+}
+
+/**
+ * @brief FreeRTOS task
+ * run the LoRa transceiver state machine
+ * with LORA_DIO0_INTERRUPT, block until woken up by DIO0 interrupt or a tx request, else poll every 10ms
+ *
+ * @param pvParameters not used
+ */
+void LoRaHomeGateway::taskRxTx(void *pvParameters)
+{
+  TickType_t wait = pdMS_TO_TICKS(LORA_TASK_WAIT_TIMEOUT);
+  while (true)
+  {
+#ifdef LORA_DIO0_INTERRUPT
+    // one notification per event (RxDone, TxDone or tx request)
+    // timeout on the next ACK timer, or as a safety net for a missed edge
+    ulTaskNotifyTake(pdFALSE, wait);
+#else
+    // give the opportunity to the IDLE task to run, and so avoid the TaskWatchDog timer to trigger a reset
+    vTaskDelay(wait);
+#endif
+    perf_stats_wakeup();
+    wait = process();
+  }
 }
 
 /**
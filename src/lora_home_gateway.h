@@ -10,9 +10,65 @@
 
 #include "lora_home_packet.h"
 #include "lora_home_configuration.h"
+#include "dongle_configuration.h"
+#include "packet_pool.h"
+#include "serial_api.h"
 
 const uint8_t LH_MQTT_MSG_MAX_SIZE = 128; // to align with MQTT_MAX_PACKET_SIZE in PubSubClient 
 
+/**
+ * @brief LoRa transceiver states managed by the LoRa task
+ * IDLE until enabled, RX listening for packets, SCAN looking for activity on the scanned channels (CH_SCAN),
+ * CAD checking the channel before transmitting, TX waiting for TxDone
+ */
+typedef enum
+{
+  LH_RADIO_IDLE,
+  LH_RADIO_RX,
+  LH_RADIO_SCAN,
+  LH_RADIO_CAD,
+  LH_RADIO_TX
+} LH_RADIO_STATE;
+
+/**
+ * @brief tx traffic classes, served with strict priority
+ * GW_ACK gateway ACKs of node uplinks, then downlinks requesting an ACK, then best effort downlinks
+ */
+typedef enum
+{
+  LH_TX_CLASS_GW_ACK = 0,
+  LH_TX_CLASS_DOWNLINK_ACK_REQ = 1,
+  LH_TX_CLASS_DOWNLINK_NO_ACK = 2,
+  LH_TX_CLASS_COUNT
+} LH_TX_CLASS;
+
+/**
+ * @brief state of an in flight downlink slot
+ * FREE slot available, TX_PENDING to be (re)transmitted, TX ongoing transmission, WAIT_ACK waiting for the node ACK
+ */
+typedef enum
+{
+  LH_INFLIGHT_FREE,
+  LH_INFLIGHT_TX_PENDING,
+  LH_INFLIGHT_TX,
+  LH_INFLIGHT_WAIT_ACK
+} LH_INFLIGHT_STATE;
+
+/**
+ * @brief downlink sent to a node and waiting for its ACK
+ * identified by (nodeIdRecipient, counter) of the lora home packet header
+ * the slot owns a reference on the packet buffer until freed
+ *
+ * @return typedef struct
+ */
+typedef struct
+{
+  LH_INFLIGHT_STATE state;
+  uint8_t tx_count;
+  unsigned long ack_deadline;
+  PACKET_BUFFER *packet;
+} LH_INFLIGHT_DOWNLINK;
+
 extern const char *JSON_KEY_NODE_NAME;
 extern const char *JSON_KEY_TX_COUNTER;
 
@@ -22,37 +78,98 @@ class LoRaHomeGateway
 public:
     LoRaHomeGateway();
     void setup(LORA_CONFIGURATION *lc, uint16_t network_id);
-    void putPacket(uint8_t *packet);
+    bool putPacket(PACKET_BUFFER *packet);
     void forwardMessageToNode(char *mqttJsonMsg);
-    bool popLoRaHomePayload(uint8_t *rxBuffer);
+    bool popLoRaHomePayload(PACKET_BUFFER **packet, TickType_t wait);
     void putAck(uint8_t nodeIdRecipient, uint16_t counter);
     void enable();
     void disable();
     void setNetworkID(uint16_t network_id);
+    void reconfigure(LORA_CONFIGURATION *lc);
+    uint8_t getTxQueueDepth(LH_TX_CLASS tx_class);
+    bool isTxQueueFull(PACKET_BUFFER *packet);
+    static TickType_t process();
+    void getCredits(DONGLE_CREDITS_PACKET_PAYLOAD *credits);
 
 
 private:
+    static LH_TX_CLASS txClass(PACKET_BUFFER *packet);
     static void rxMode();
+    static void listen();
+    static void scanNext();
+    static void tune(long frequency);
+    static long txFrequency(const uint8_t *frame);
+    static TickType_t serveTx(TickType_t wait);
     static void txMode();
     static void onReceive(int packet_size);
     static void send();
+    static void onTxDone(bool done = true);
+    static bool sendInflight();
+    static bool sendQueued(LH_TX_CLASS tx_class);
+    static bool startTx(PACKET_BUFFER *packet);
+    static void transmit();
+    static void listenBeforeTalk();
+    static void onCadDone(bool detected);
+    static void ackInflight(uint8_t nodeIdEmitter, uint16_t counter);
+    static void freeInflight(LH_INFLIGHT_DOWNLINK *downlink);
+    static TickType_t checkInflight();
     static bool checkCRC(const uint8_t *packet, uint8_t length);
-    static uint16_t crc16_ccitt(const uint8_t *data, unsigned int data_len);
     static void taskRxTx(void *pvParameters);
+    static void onDio0Rise();
+    static void notify();
+    static void returnCredit();
+    static void applyConfig();
 
 public:
     static uint32_t rx_counter;
     static uint32_t tx_counter;
     static uint32_t err_counter;
+    static uint32_t downlink_lost_counter;
+    static uint32_t duplicate_counter;
+    static uint32_t tx_deferred_counter;
+    static uint32_t airtime_budget;
+    static uint32_t tx_drop_counter[LH_TX_CLASS_COUNT];
+    static uint32_t lbt_busy_counter;
+    static uint32_t lbt_forced_counter;
+    static uint32_t scan_hit_counter[LORA_SCAN_CHANNEL_COUNT];
+    static uint32_t channel_rx_counter[LORA_SCAN_CHANNEL_COUNT];
+    static uint32_t downlink_counter;
+    static uint32_t downlink_credit_limit;
+    static uint32_t credit_overrun_counter;
+    static uint32_t retune_us;
+    static uint32_t foreign_counter[LORA_SCAN_CHANNEL_COUNT];
+    static uint32_t scan_miss_counter[LORA_SCAN_CHANNEL_COUNT];
+    static uint32_t channel_airtime_budget[LORA_SCAN_CHANNEL_COUNT];
+    static uint8_t sync_word;
     static unsigned long last_packet_ts;
 
 private:
     static QueueHandle_t rx_packet_queue;
-    static QueueHandle_t rx_ack_packet_queue;
-    static QueueHandle_t tx_packet_queue; 
+    static QueueHandle_t tx_packet_queue[LH_TX_CLASS_COUNT];
     static uint16_t packet_id_counter;
     static uint16_t network_id;
+    static LH_RADIO_STATE radio_state;
+    static unsigned long tx_start_ts;
+    static LH_INFLIGHT_DOWNLINK inflight[MAX_INFLIGHT_DOWNLINKS];
+    static LH_INFLIGHT_DOWNLINK *tx_inflight;
+    static LORA_CONFIGURATION lora_config;
+    static uint32_t tx_defer_ms;
+    static PACKET_BUFFER *tx_packet;
+    static uint8_t lbt_attempts;
+    static unsigned long lbt_retry_ts;
+    static long current_frequency;
+    static long tx_frequency;
+    static uint8_t scan_index;
+    static bool scan_locked;
+    static unsigned long scan_lock_ts;
+    static uint32_t scan_lock_ms;
+    static volatile uint32_t dio0_ts;
+    static bool enabled;
     static bool run;
+    static LORA_CONFIGURATION pending_config;
+    static volatile bool reconfigure_pending;
+    static volatile bool sync_word_pending;
+    static unsigned long reconfigure_ts;
 };
 
 extern LoRaHomeGateway lhg;
@@ -15,6 +15,12 @@
 #include "lora_home_configuration.h"
 #include "data_storage.h"
 #include "version.h"
+#include "crc16.h"
+#include "node_table.h"
+#include "packet_pool.h"
+#include "perf_stats.h"
+#include "reactor.h"
+#include "log_ring.h"
 
 // uncomment to activate the watchdog
 #define WATCHDOG
@@ -36,6 +42,11 @@ DataStorage data_storage;
 TaskHandle_t taskHandle = NULL;
 TimerHandle_t xTimerDisplayRefresh = NULL;
 
+// link change waiting for the host echo to confirm it, reply sys type, 0 if none
+static uint8_t link_pending = 0;
+static UART_LINK_SETTINGS link_pending_settings;
+static unsigned long link_switch_ts = 0;
+
 #ifdef WATCHDOG
 
 /**
@@ -48,120 +59,458 @@ void IRAM_ATTR resetModule()
 }
 #endif
 
+// node stats stream in progress: next node id to report, NODE_TABLE_SIZE once the last packet is sent
+static uint16_t node_stats_next = NODE_TABLE_SIZE;
+// packet being filled, node_stats_ready once complete and waiting for room in the uart tx queue
+static DONGLE_NODE_STATS_PACKET_PAYLOAD node_stats;
+static bool node_stats_ready = false;
+
+/**
+ * @brief go on streaming the link statistics of the nodes, from where the stream stopped
+ * a packet that does not fit in the uart tx queue is kept, and sent on the next call
+ *
+ * @return true once the last packet is sent, or if no stream is in progress
+ * @return false if the uart tx queue is full, to be called again once it drained
+ */
+bool node_stats_process()
+{
+  DONGLE_NODE_STATS_PACKET_PAYLOAD *payload = &node_stats;
+  NODE_TABLE_ENTRY entry;
+  unsigned long now = millis();
+  while (node_stats_next < NODE_TABLE_SIZE)
+  {
+    uint16_t node_id = node_stats_next;
+    if (!node_stats_ready && node_table_get(node_id, &entry))
+    {
+      DONGLE_NODE_STATS *stats = &payload->nodes[payload->count++];
+      stats->node_id = node_id;
+      stats->rssi_last = entry.rssi_last;
+      stats->rssi_avg = entry.rssi_avg_x16 / 16;
+      stats->snr_last = entry.snr_last;
+      stats->snr_avg = entry.snr_avg_x16 / 16;
+      stats->channel = entry.channel;
+      stats->last_seen_age = now - entry.last_seen;
+      stats->uplink_counter = entry.uplink_counter;
+      stats->lost_counter = entry.lost_counter;
+    }
+    // send the packet when full, and always a last one, possibly empty
+    node_stats_ready = (NODE_STATS_PER_PACKET == payload->count) || ((NODE_TABLE_SIZE - 1) == node_id);
+    if (node_stats_ready)
+    {
+      payload->last = ((NODE_TABLE_SIZE - 1) == node_id);
+      uint8_t size = sizeof(DONGLE_NODE_STATS_PACKET_PAYLOAD) - (NODE_STATS_PER_PACKET - payload->count) * sizeof(DONGLE_NODE_STATS);
+      // the table does not fit in the uart tx queue, resume once it drained
+      if (!serial_api_send_sys_payload(TYPE_SYS_INFO_NODE_STATS, payload, size))
+      {
+        return false;
+      }
+      payload->sequence++;
+      payload->count = 0;
+      node_stats_ready = false;
+    }
+    node_stats_next++;
+  }
+  return true;
+}
+
+/**
+ * @brief send the link statistics of every node heard to the host
+ * streamed as TYPE_SYS_INFO_NODE_STATS packets of NODE_STATS_PER_PACKET nodes, a stream in progress starts over
+ * the single reactor only starts the stream, and goes on with it at each iteration not to hold the other stages
+ */
+void send_node_stats()
+{
+  node_stats.sequence = 0;
+  node_stats.count = 0;
+  node_stats_ready = false;
+  node_stats_next = 0;
+#ifdef SINGLE_REACTOR
+  node_stats_process();
+#else
+  while (!node_stats_process())
+  {
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+  }
+#endif
+}
+
+/**
+ * @brief send the activity of each channel of the scan set to the host
+ *
+ */
+void send_channel_stats()
+{
+  DONGLE_CHANNEL_STATS_PACKET_PAYLOAD channel_stats;
+  DONGLE_CHANNEL_STATS_PACKET_PAYLOAD *payload = &channel_stats;
+  payload->count = LORA_SCAN_CHANNEL_COUNT;
+  for (uint8_t i = 0; i < LORA_SCAN_CHANNEL_COUNT; i++)
+  {
+    payload->channels[i].channel = LORA_SCAN_CHANNELS[i];
+    payload->channels[i].scan_hit_counter = lhg.scan_hit_counter[i];
+    payload->channels[i].rx_counter = lhg.channel_rx_counter[i];
+    payload->channels[i].foreign_counter = lhg.foreign_counter[i];
+    payload->channels[i].scan_miss_counter = lhg.scan_miss_counter[i];
+    payload->channels[i].airtime_budget = lhg.channel_airtime_budget[i];
+  }
+  payload->sync_word = lhg.sync_word;
+  serial_api_send_sys_payload(TYPE_SYS_INFO_CHANNEL_STATS, payload, sizeof(DONGLE_CHANNEL_STATS_PACKET_PAYLOAD));
+}
+
+/**
+ * @brief send the forwarding path performance to the host
+ *
+ */
+void send_perf_stats()
+{
+  PERF_STATS stats;
+  perf_stats_get(&stats);
+  DONGLE_PERF_STATS_PACKET_PAYLOAD payload = {0};
+  payload.uplink_counter = stats.uplink_counter;
+  if (0 != stats.uplink_counter)
+  {
+    payload.uplink_bytes_copied = stats.uplink_bytes_copied / stats.uplink_counter;
+    payload.uplink_cycles = stats.uplink_cycles / stats.uplink_counter;
+    payload.uplink_latency_us = stats.uplink_latency_us / stats.uplink_counter;
+  }
+  payload.uplink_latency_max_us = stats.uplink_latency_max_us;
+  payload.pool_available = packet_pool_available();
+  payload.pool_min_available = packet_pool_min_available();
+  payload.pool_alloc_fail_counter = packet_pool_alloc_fail_counter();
+#ifdef SINGLE_REACTOR
+  payload.single_reactor = 1;
+  payload.stack_reserved = REACTOR_TASK_STACK_SIZE + LOG_TASK_STACK_SIZE;
+#else
+  payload.single_reactor = 0;
+  payload.stack_reserved = 5 * PIPELINE_TASK_STACK_SIZE + LORA_TASK_STACK_SIZE + LOG_TASK_STACK_SIZE;
+#endif
+  payload.wakeup_counter = stats.wakeup_counter;
+  payload.free_heap = ESP.getFreeHeap();
+  payload.min_free_heap = ESP.getMinFreeHeap();
+  payload.tx_frame_counter = stats.tx_frame_counter;
+  payload.tx_burst_counter = stats.tx_burst_counter;
+  payload.tx_frames_per_s_max = stats.tx_frames_per_s_max;
+  payload.dispatch_unknown_counter = serial_api_unknown_counter;
+  payload.dispatch_drop_counter = serial_api_drop_counter;
+  payload.config_load_us = data_storage.config_load_us;
+  payload.config_save_counter = data_storage.config_save_counter;
+  payload.config_write_counter = data_storage.config_write_counter;
+  payload.retune_us = lhg.retune_us;
+  serial_api_send_sys_payload(TYPE_SYS_INFO_PERF_STATS, &payload, sizeof(DONGLE_PERF_STATS_PACKET_PAYLOAD));
+}
+
+/**
+ * @brief reply to a link change
+ *
+ * @param sys_type TYPE_SYS_INFO_BAUD_RATE or TYPE_SYS_INFO_FRAMING
+ * @param link link settings, the baud rate or framing of the reply
+ * @param status LINK_CHANGE_STATUS
+ * @param do_switch switch to the link settings once the reply is sent
+ * @return true if queued for transmission
+ * @return false if the uart tx queue is full
+ */
+bool send_link_change(uint8_t sys_type, const UART_LINK_SETTINGS *link, LINK_CHANGE_STATUS status, bool do_switch)
+{
+  const UART_LINK_SETTINGS *switch_link = do_switch ? link : NULL;
+  log_ring_put(LOG_ID_LINK_CHANGE, link->baud_rate, link->framing, status);
+  if (TYPE_SYS_INFO_BAUD_RATE == sys_type)
+  {
+    DONGLE_BAUD_RATE_PACKET_PAYLOAD payload;
+    payload.baud_rate = link->baud_rate;
+    payload.status = status;
+    return serial_api_send_sys_payload(sys_type, &payload, sizeof(DONGLE_BAUD_RATE_PACKET_PAYLOAD), switch_link);
+  }
+  DONGLE_FRAMING_PACKET_PAYLOAD payload;
+  payload.framing = link->framing;
+  payload.status = status;
+  return serial_api_send_sys_payload(sys_type, &payload, sizeof(DONGLE_FRAMING_PACKET_PAYLOAD), switch_link);
+}
+
+/**
+ * @brief switch to the link settings requested by the host, once the reply is sent
+ * the host switches on reception of the reply, and confirms with an echo with the new settings
+ *
+ * @param sys_type TYPE_SYS_INFO_BAUD_RATE or TYPE_SYS_INFO_FRAMING
+ * @param link link settings requested
+ * @param valid whether the setting requested is supported
+ */
+void change_link(uint8_t sys_type, const UART_LINK_SETTINGS *link, bool valid)
+{
+  if ((0 != link_pending) || !valid)
+  {
+    send_link_change(sys_type, link, LINK_CHANGE_REJECTED, false);
+    return;
+  }
+  if (send_link_change(sys_type, link, LINK_CHANGE_ACCEPTED, true))
+  {
+    link_pending = sys_type;
+    link_pending_settings = *link;
+    link_switch_ts = millis();
+  }
+}
+
+/**
+ * @brief switch to the baud rate requested by the host
+ *
+ * @param baud_rate baud rate requested
+ */
+void set_baud_rate(uint32_t baud_rate)
+{
+  UART_LINK_SETTINGS link = data_storage.get_uart_link();
+  link.baud_rate = baud_rate;
+  change_link(TYPE_SYS_INFO_BAUD_RATE, &link, uart_is_valid_baud_rate(baud_rate));
+}
+
+/**
+ * @brief switch to the framing requested by the host
+ *
+ * @param framing UART_FRAMING requested
+ */
+void set_framing(uint8_t framing)
+{
+  UART_LINK_SETTINGS link = data_storage.get_uart_link();
+  link.framing = (UART_FRAMING)framing;
+  change_link(TYPE_SYS_INFO_FRAMING, &link, framing < UART_FRAMING_COUNT);
+}
+
+/**
+ * @brief confirm the new link settings on the host echo, and save them
+ *
+ */
+void confirm_link()
+{
+  if (0 != link_pending)
+  {
+    data_storage.set_uart_link(&link_pending_settings);
+    send_link_change(link_pending, &link_pending_settings, LINK_CHANGE_CONFIRMED, false);
+    link_pending = 0;
+  }
+}
+
+/**
+ * @brief fall back to the saved link settings if the host did not confirm the new ones in time
+ * the reply is sent with the settings abandoned, the host falls back on its own timeout anyway
+ *
+ */
+void check_link()
+{
+  if ((0 != link_pending) && ((millis() - link_switch_ts) > LINK_CONFIRM_TIMEOUT))
+  {
+    UART_LINK_SETTINGS link = data_storage.get_uart_link();
+    if (send_link_change(link_pending, &link, LINK_CHANGE_FALLBACK, true))
+    {
+      link_pending = 0;
+    }
+  }
+}
+
+/**
+ * @brief process a system packet received on the UART, and release it
+ *
+ * @param rx_buffer packet buffer holding the serial packet
+ */
+void process_sys_packet(PACKET_BUFFER *rx_buffer)
+{
+  SERIAL_PACKET *serial_packet;
+  serial_packet = (SERIAL_PACKET *)rx_buffer->data;
+  DONGLE_SYS_PACKET *sys_packet;
+  sys_packet = (DONGLE_SYS_PACKET *)serial_packet->data;
+  LORA_CONFIGURATION *lc;
+  switch (sys_packet->sys_type)
+  {
+  case TYPE_SYS_SET_LORA_SETTINGS:
+    lc = (LORA_CONFIGURATION *)sys_packet->payload;
+    data_storage.set_lora_configuration(lc);
+    log_ring_put(LOG_ID_LORA_SETTINGS, lc->channel, lc->bandwidth, lc->coding_rate, lc->spreading_factor);
+    lhg.reconfigure(lc);
+    break;
+  case TYPE_SYS_RESET:
+    esp_restart();
+    break;
+  case TYPE_SYS_GET_ALL_SETTINGS:
+    log_ring_put(LOG_ID_ALL_SETTINGS);
+    DONGLE_ALL_SETTINGS_PACKET_PAYLOAD packet_settings;
+    packet_settings.version_major = VERSION_MAJOR;
+    packet_settings.version_minor = VERSION_MINOR;
+    packet_settings.version_patch = VERSION_PATCH;
+    packet_settings.lora_config = data_storage.get_lora_configuration();
+    packet_settings.lora_home_network_id = data_storage.get_lora_home_network_id();
+    serial_api_send_sys_payload(TYPE_SYS_INFO_ALL_SETTINGS, &packet_settings, sizeof(DONGLE_ALL_SETTINGS_PACKET_PAYLOAD));
+    break;
+  case TYPE_SYS_GET_NODE_STATS:
+    send_node_stats();
+    break;
+  case TYPE_SYS_GET_CHANNEL_STATS:
+    send_channel_stats();
+    break;
+  case TYPE_SYS_GET_PERF_STATS:
+    send_perf_stats();
+    break;
+  case TYPE_SYS_SET_BAUD_RATE:
+    set_baud_rate(((DONGLE_BAUD_RATE_PACKET_PAYLOAD *)sys_packet->payload)->baud_rate);
+    break;
+  case TYPE_SYS_SET_FRAMING:
+    set_framing(((DONGLE_FRAMING_PACKET_PAYLOAD *)sys_packet->payload)->framing);
+    break;
+  case TYPE_SYS_ECHO:
+    // echo back as is, then confirm the link change if any
+    serial_api_send_sys_packet((uint8_t *)sys_packet, serial_packet->header.data_length);
+    confirm_link();
+    break;
+  case TYPE_SYS_SET_LORA_HOME_NETWORK_ID:
+    uint16_t *value = (uint16_t *)sys_packet->payload;
+    log_ring_put(LOG_ID_NETWORK_ID, *value);
+    data_storage.set_lora_home_network_id(*value);
+    lhg.setNetworkID(*value);
+    break;
+  }
+  packet_pool_release(rx_buffer);
+}
+
 /**
  * @brief FreeRTOS task
- * process incoming system packets on the UART
+ * process incoming system packets on the UART, blocks until one is available
  * @param pvParameters not used
  */
 void task_sys_dongle(void *pvParameters)
 {
-  SERIAL_PACKET *serial_packet;
-  uint8_t rx_buffer[256];
+  PACKET_BUFFER *rx_buffer;
   while (1)
   {
-    if (serial_api_get_sys_dongle_packet(rx_buffer))
+    if (serial_api_get_sys_dongle_packet(&rx_buffer, pdMS_TO_TICKS(PIPELINE_TASK_WAIT_TIMEOUT)))
     {
-      serial_packet = (SERIAL_PACKET *)rx_buffer;
-      DONGLE_SYS_PACKET *sys_packet;
-      sys_packet = (DONGLE_SYS_PACKET *)serial_packet->data;
-      LORA_CONFIGURATION *lc;
-      // char buffer[256] = "\nTask_sys_dongle:";
-      switch (sys_packet->sys_type)
-      {
-      case TYPE_SYS_SET_LORA_SETTINGS:
-        lc = (LORA_CONFIGURATION *)sys_packet->payload;
-        data_storage.set_lora_configuration(lc);
-        // sprintf(buffer + strlen(buffer), "\n - Channel = %i", lc->channel);
-        // sprintf(buffer + strlen(buffer), "\n - Bandwidth = %i", lc->bandwidth);
-        // sprintf(buffer + strlen(buffer), "\n - Coding Rage = %i", lc->coding_rate);
-        // sprintf(buffer + strlen(buffer), "\n - Spreading Factor = %i", lc->spreading_factor);
-        // serial_api_send_log_message(buffer);
-        lhg.disable();
-        lhg.setup(lc, data_storage.get_lora_home_network_id());
-        lhg.enable();
-        break;
-      case TYPE_SYS_RESET:
-        esp_restart();
-        break;
-      case TYPE_SYS_GET_ALL_SETTINGS:
-        // sprintf(buffer + strlen(buffer), " sending all settings");
-        // serial_api_send_log_message(buffer);
-        DONGLE_ALL_SETTINGS_PACKET_PAYLOAD packet_settings;
-        packet_settings.version_major = VERSION_MAJOR;
-        packet_settings.version_minor = VERSION_MINOR;
-        packet_settings.version_patch = VERSION_PATCH;
-        packet_settings.lora_config = data_storage.get_lora_configuration();
-        packet_settings.lora_home_network_id = data_storage.get_lora_home_network_id();
-        DONGLE_SYS_PACKET packet;
-        packet.sys_type = TYPE_SYS_INFO_ALL_SETTINGS;
-        memcpy(packet.payload, &packet_settings, sizeof(DONGLE_ALL_SETTINGS_PACKET_PAYLOAD));
-        serial_api_send_sys_packet((uint8_t *)&packet, +sizeof(packet.sys_type) + sizeof(DONGLE_ALL_SETTINGS_PACKET_PAYLOAD));
-        break;
-      case TYPE_SYS_SET_LORA_HOME_NETWORK_ID:
-        uint16_t *value = (uint16_t *)sys_packet->payload;
-        // sprintf(buffer + strlen(buffer), " network_id = %02x", *value);
-        // serial_api_send_log_message(buffer);
-        data_storage.set_lora_home_network_id(*value);
-        lhg.setNetworkID(*value);
-        break;
-      }
+      process_sys_packet(rx_buffer);
     }
-    vTaskDelay(10 / portTICK_PERIOD_MS);
+    check_link();
+    perf_stats_wakeup();
   }
 }
 
 /**
  * @brief FreeRTOS task
- * forward lora home packet received on the UART on the air
+ * forward lora home packet received on the UART on the air, blocks until one is available
  * @param pvParameters not used
  */
 void task_lora_home_send(void *pvParameters)
 {
-  SERIAL_PACKET *serial_packet; // Buffer to hold received messages
-  LORA_HOME_PACKET *lora_packet;
-  uint8_t rx_buffer[256];
+  PACKET_BUFFER *rx_buffer; // Buffer holding the received serial packet
   while (1)
   {
-    if (serial_api_get_lora_home_packet(rx_buffer))
+    if (serial_api_get_lora_home_packet(&rx_buffer, pdMS_TO_TICKS(PIPELINE_TASK_WAIT_TIMEOUT)))
     {
-      serial_packet = (SERIAL_PACKET *)rx_buffer;
-      lora_packet = (LORA_HOME_PACKET *)serial_packet->data;
-      lhg.putPacket((uint8_t *)lora_packet);
-      // char buffer[256] = "\0";
-      // for (int i = 0; i < serial_packet->header.data_length + sizeof(SERIAL_PACKET_HEADER); i++)
-      // {
-      //   sprintf(buffer + strlen(buffer), "%02x:", rx_buffer[i]);
-      // }
-      // serial_api_send_log_message(buffer);
+      // the lora home packet is the serial packet data, handed over as is
+      lhg.putPacket(rx_buffer);
     }
-    vTaskDelay(10 / portTICK_PERIOD_MS);
+    perf_stats_wakeup();
   }
 }
 
+/**
+ * @brief forward a lora packet through the UART
+ *
+ * @param packet packet buffer holding the lora home packet, handed over
+ */
+void forward_uplink(PACKET_BUFFER *packet)
+{
+#ifdef WATCHDOG
+  timerWrite(timer, 0);
+#endif
+  LORA_HOME_PACKET *lhp = (LORA_HOME_PACKET *)&packet->data[PACKET_POOL_HEADROOM];
+  uint8_t size = sizeof(LORA_HOME_PACKET_HEADER) + lhp->header.payloadSize; // + LH_FRAME_FOOTER_SIZE;
+  serial_api_send_lora_home_packet(packet, size);
+}
+
 /**
  * @brief FreeRTOS task
- * check whether lora packets are available and forward them through the UART
+ * wait for lora packets and forward them through the UART
  *
  * @param pvParameters not used
  */
 void task_lora_home_receive(void *pvParameters)
 {
-  uint8_t packet[LH_FRAME_MAX_SIZE];
+  PACKET_BUFFER *packet;
   while (1)
   {
-    if (lhg.popLoRaHomePayload(packet))
+    if (lhg.popLoRaHomePayload(&packet, pdMS_TO_TICKS(PIPELINE_TASK_WAIT_TIMEOUT)))
     {
-#ifdef WATCHDOG
-      timerWrite(timer, 0);
-#endif
-      LORA_HOME_PACKET *lhp = (LORA_HOME_PACKET *)packet;
-      uint8_t size = sizeof(LORA_HOME_PACKET_HEADER) + lhp->header.payloadSize; // + LH_FRAME_FOOTER_SIZE;
-      serial_api_send_lora_home_packet(packet, size);
+      forward_uplink(packet);
     }
-    vTaskDelay(10 / portTICK_PERIOD_MS);
+    perf_stats_wakeup();
+  }
+}
+
+#ifdef SINGLE_REACTOR
+/**
+ * @brief forward the lora home packets received on the UART to the LoRa tx queues, without blocking
+ * a packet waits for room in its tx queue as long as putPacket would block in the multi task mode
+ *
+ */
+void lora_home_send_process()
+{
+  static PACKET_BUFFER *pending = NULL;
+  static unsigned long pending_ts = 0;
+  while (true)
+  {
+    if (NULL == pending)
+    {
+      if (!serial_api_get_lora_home_packet(&pending, 0))
+      {
+        return;
+      }
+      pending_ts = millis();
+    }
+    if (lhg.isTxQueueFull(pending) && ((millis() - pending_ts) < (ACK_TIMEOUT * MAX_RETRY_NO_VALID_ACK)))
+    {
+      return;
+    }
+    // dropped if the tx queue is still full
+    lhg.putPacket(pending);
+    pending = NULL;
   }
 }
 
+/**
+ * @brief FreeRTOS task
+ * single reactor: run every stage of the pipeline from one event queue
+ * - UART_RX: decode received bytes, process system packets
+ * - any event or timeout: forward packets to the LoRa tx queues, step the LoRa transceiver state machine,
+ *   forward LoRa packets to the UART, write the UART tx queue
+ *
+ * @param pvParameters not used
+ */
+void task_reactor(void *pvParameters)
+{
+  REACTOR_EVENT event;
+  PACKET_BUFFER *packet;
+  TickType_t wait = pdMS_TO_TICKS(LORA_TASK_WAIT_TIMEOUT);
+  while (1)
+  {
+    bool any = reactor_wait(&event, wait);
+    perf_stats_wakeup();
+    if (any && (REACTOR_EVENT_UART_RX == event))
+    {
+      uart_rx_process(0);
+    }
+    lora_home_send_process();
+    while (serial_api_get_sys_dongle_packet(&packet, 0))
+    {
+      process_sys_packet(packet);
+    }
+    check_link();
+    wait = lhg.process();
+    while (lhg.popLoRaHomePayload(&packet, 0))
+    {
+      forward_uplink(packet);
+    }
+    uart_tx_process();
+    // node stats stream waiting for room in the uart tx queue, check again shortly
+    if (!node_stats_process() && (pdMS_TO_TICKS(10) < wait))
+    {
+      wait = pdMS_TO_TICKS(10);
+    }
+  }
+}
+#endif
+
 /**
  * @brief FreeRTOS timer (every 1s)
  * refresh display each time is called
@@ -179,11 +528,9 @@ void timer_heartbeat(TimerHandle_t xTimer)
     packet_heartbeat.err_counter = lhg.err_counter;
     packet_heartbeat.rx_counter = lhg.rx_counter;
     packet_heartbeat.tx_counter = lhg.tx_counter;
-    DONGLE_SYS_PACKET packet_sys;
-    packet_sys.sys_type = TYPE_SYS_HEARTBEAT;
-    // packet_sys.payload = (uint8_t *)&packet_heartbeat;
-    memcpy(packet_sys.payload, &packet_heartbeat, sizeof(DONGLE_HEARTBEAT_PACKET_PAYLOAD));
-    serial_api_send_sys_packet((uint8_t *)&packet_sys, sizeof(DONGLE_HEARTBEAT_PACKET_PAYLOAD) + sizeof(packet_sys.sys_type));
+    packet_heartbeat.airtime_budget = lhg.airtime_budget;
+    lhg.getCredits(&packet_heartbeat.credits);
+    serial_api_send_sys_payload(TYPE_SYS_HEARTBEAT, &packet_heartbeat, sizeof(DONGLE_HEARTBEAT_PACKET_PAYLOAD));
     time = millis();
   }
 }
@@ -199,14 +546,35 @@ void timer_heartbeat(TimerHandle_t xTimer)
  */
 void setup()
 {
+  log_ring_init();
   data_storage.init();
   data_storage.load_configuration();
   display.init();
   display.showUsbStatus(false);
   display.showLoRaStatus(false);
-  uart_init();
+#ifdef SINGLE_REACTOR
+  reactor_init();
+#endif
+  UART_LINK_SETTINGS link = data_storage.get_uart_link();
+  uart_init(&link);
   serial_api_init();
   display.showUsbStatus(true);
+  log_ring_put(LOG_ID_BOOT, VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
+#ifdef CRC16_BENCHMARK
+  crc16_benchmark();
+#endif
+#ifdef UART_FRAMING_BENCHMARK
+  uart_framing_benchmark();
+#endif
+#ifdef UART_TX_BENCHMARK
+  uart_tx_benchmark();
+#endif
+#ifdef SERIAL_API_BENCHMARK
+  serial_api_benchmark();
+#endif
+#ifdef DATA_STORAGE_BENCHMARK
+  data_storage.benchmark();
+#endif
 
 #ifdef WATCHDOG
   // watchdog configuration
@@ -222,11 +590,17 @@ void setup()
   lhg.enable();
   display.showLoRaStatus(true);
   // create tasks
-  xTaskCreate(task_uart_rx, "task_uart_rx", 2048, NULL, 1, NULL);
-  xTaskCreate(task_uart_tx, "task_uart_tx", 2048, NULL, 1, NULL);
-  xTaskCreate(task_lora_home_send, "task_lora_home_send", 2048, NULL, 1, NULL);
-  xTaskCreate(task_lora_home_receive, "task_lora_home_receive", 2048, NULL, 1, NULL);
-  xTaskCreate(task_sys_dongle, "task_sys_dongle", 2048, NULL, 1, NULL);
+#ifdef SINGLE_REACTOR
+  xTaskCreate(task_reactor, "task_reactor", REACTOR_TASK_STACK_SIZE, NULL, 1, NULL);
+#else
+  xTaskCreate(task_uart_rx, "task_uart_rx", PIPELINE_TASK_STACK_SIZE, NULL, 1, NULL);
+  xTaskCreate(task_uart_tx, "task_uart_tx", PIPELINE_TASK_STACK_SIZE, NULL, 1, NULL);
+  xTaskCreate(task_lora_home_send, "task_lora_home_send", PIPELINE_TASK_STACK_SIZE, NULL, 1, NULL);
+  xTaskCreate(task_lora_home_receive, "task_lora_home_receive", PIPELINE_TASK_STACK_SIZE, NULL, 1, NULL);
+  xTaskCreate(task_sys_dongle, "task_sys_dongle", PIPELINE_TASK_STACK_SIZE, NULL, 1, NULL);
+#endif
+  // below the pipeline, logs are shipped when the dongle has nothing else to do
+  xTaskCreate(task_log, "task_log", LOG_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY, NULL);
   xTimerDisplayRefresh = xTimerCreate("timer_heartbeat", pdMS_TO_TICKS(DISPLAY_TIMEOUT_REFRESH), pdTRUE, 0, timer_heartbeat);
   xTimerStart(xTimerDisplayRefresh, 0);
 }
@@ -0,0 +1,140 @@
+/**
+ * @file node_table.cpp
+ * @author mchacher
+ * @brief  per node table of the lora home gateway
+ * detect duplicate uplinks (same node, same counter), e.g. a frame sent again because the gateway ACK was lost
+ * keep link statistics of each node: rssi, snr, channel, last seen, uplinks received and lost (counter gaps)
+ * updated by the LoRa task only, entries can be read from other tasks with node_table_get
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <Arduino.h>
+#include "node_table.h"
+
+// number of counters tracked by the recent window
+#define NODE_TABLE_WINDOW_SIZE 32
+// moving average weight of the last sample, 1/8
+#define NODE_TABLE_AVG_SHIFT 3
+// silence (ms) after which an older counter is a node restart, retransmissions of an uplink come within a few ACK timeouts
+#define NODE_TABLE_RESTART_DELAY 10000
+
+static NODE_TABLE_ENTRY node_table[NODE_TABLE_SIZE] = {};
+static portMUX_TYPE node_table_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief check whether an uplink was already received, and record it
+ * a counter not ahead of the last one is taken as a node restart, and the window reset, if it is:
+ * - more than NODE_TABLE_WINDOW_SIZE behind
+ * - heard more than NODE_TABLE_RESTART_DELAY after the last uplink of the node
+ * - the last counter, with another frame crc
+ * counters skipped are accounted as lost uplinks, until received late
+ *
+ * @param node_id node id of the emitter
+ * @param counter counter of the lora home packet header
+ * @param crc crc of the frame, tells a retransmission from another uplink with the same counter
+ * @return true if already received
+ * @return false if new
+ */
+bool node_table_is_duplicate(uint8_t node_id, uint16_t counter, uint16_t crc)
+{
+  NODE_TABLE_ENTRY *entry = &node_table[node_id];
+  int16_t delta = (int16_t)(counter - entry->last_counter);
+  uint32_t now = millis();
+  bool duplicate = false;
+
+  portENTER_CRITICAL(&node_table_mux);
+  bool restart = (delta <= -NODE_TABLE_WINDOW_SIZE) ||
+                 ((delta <= 0) && ((now - entry->last_uplink_ts) > NODE_TABLE_RESTART_DELAY)) ||
+                 ((0 == delta) && (crc != entry->last_crc));
+  if ((0 == entry->window) || (delta > 0) || restart)
+  {
+    // first frame, newer frame or node restart
+    if ((0 < delta) && (0 != entry->window))
+    {
+      entry->lost_counter += delta - 1;
+      entry->window = (delta < NODE_TABLE_WINDOW_SIZE) ? ((entry->window << delta) | 1) : 1;
+    }
+    else
+    {
+      entry->window = 1;
+    }
+    entry->last_counter = counter;
+    entry->last_crc = crc;
+  }
+  else
+  {
+#ifdef NODE_TABLE_RECENT_WINDOW
+    uint32_t bit = 1UL << (-delta);
+    if (entry->window & bit)
+    {
+      duplicate = true;
+    }
+    else
+    {
+      // late frame, no longer lost
+      entry->window |= bit;
+      if (entry->lost_counter > 0)
+      {
+        entry->lost_counter--;
+      }
+    }
+#else
+    duplicate = (0 == delta);
+#endif
+  }
+  if (!duplicate)
+  {
+    entry->uplink_counter++;
+  }
+  entry->last_uplink_ts = now;
+  portEXIT_CRITICAL(&node_table_mux);
+  return duplicate;
+}
+
+/**
+ * @brief record link quality of a frame received from a node
+ *
+ * @param node_id node id of the emitter
+ * @param rssi packet rssi in dBm
+ * @param snr packet snr in 0.25 dB
+ * @param channel channel the frame was received on
+ */
+void node_table_put_link(uint8_t node_id, int16_t rssi, int8_t snr, Lora_Frequency_Channel channel)
+{
+  NODE_TABLE_ENTRY *entry = &node_table[node_id];
+
+  portENTER_CRITICAL(&node_table_mux);
+  if (!entry->active)
+  {
+    entry->rssi_avg_x16 = rssi * 16;
+    entry->snr_avg_x16 = snr * 16;
+    entry->active = true;
+  }
+  else
+  {
+    entry->rssi_avg_x16 += (rssi * 16 - entry->rssi_avg_x16) >> NODE_TABLE_AVG_SHIFT;
+    entry->snr_avg_x16 += (snr * 16 - entry->snr_avg_x16) >> NODE_TABLE_AVG_SHIFT;
+  }
+  entry->rssi_last = rssi;
+  entry->snr_last = snr;
+  entry->channel = channel;
+  entry->last_seen = millis();
+  portEXIT_CRITICAL(&node_table_mux);
+}
+
+/**
+ * @brief get a copy of a node entry
+ *
+ * @param node_id node id
+ * @param entry pointer used to return the entry
+ * @return true if the node was heard
+ * @return false if never heard
+ */
+bool node_table_get(uint8_t node_id, NODE_TABLE_ENTRY *entry)
+{
+  portENTER_CRITICAL(&node_table_mux);
+  *entry = node_table[node_id];
+  portEXIT_CRITICAL(&node_table_mux);
+  return entry->active;
+}
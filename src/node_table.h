@@ -0,0 +1,58 @@
+/**
+ * @file node_table.h
+ * @author mchacher
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef NODE_TABLE_H
+#define NODE_TABLE_H
+
+#include <Arduino.h>
+#include "lora_home_configuration.h"
+
+/**
+ * @def NODE_TABLE_SIZE
+ * @brief one entry per 8 bits node id
+ */
+#define NODE_TABLE_SIZE 256
+
+// comment to only compare with the last counter received, instead of a window of the 32 last counters
+#define NODE_TABLE_RECENT_WINDOW
+
+/**
+ * @brief what the gateway knows about a node, indexed by node id
+ * window bit i is set when counter (last_counter - i) was received, 0 if no uplink received yet
+ * last_crc frame crc of last_counter, last_uplink_ts time stamp of the last uplink, duplicates included
+ * link quality of the last frame received and its moving average (1/16 units), channel it was received on
+ *
+ * @return typedef struct
+ */
+typedef struct
+{
+  uint32_t window;
+  uint32_t last_seen;
+  uint32_t uplink_counter;
+  uint32_t lost_counter;
+  uint32_t last_uplink_ts;
+  Lora_Frequency_Channel channel;
+  uint16_t last_counter;
+  uint16_t last_crc;
+  int16_t rssi_last;
+  int16_t rssi_avg_x16;
+  int16_t snr_avg_x16;
+  int8_t snr_last;
+  bool active;
+} NODE_TABLE_ENTRY;
+
+/**
+ * @brief node restarts are detected on the counters and the silence before them, see node_table_is_duplicate
+ * limitation: a node restarting within NODE_TABLE_RESTART_DELAY (10s) of its last uplink, its counters less than 32 behind,
+ * has its uplinks with counters already received dropped as duplicates until it passes its last counter,
+ * unless its first uplink reuses the last counter with another content
+ */
+bool node_table_is_duplicate(uint8_t node_id, uint16_t counter, uint16_t crc);
+void node_table_put_link(uint8_t node_id, int16_t rssi, int8_t snr, Lora_Frequency_Channel channel);
+bool node_table_get(uint8_t node_id, NODE_TABLE_ENTRY *entry);
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * @file packet_pool.cpp
+ * @author mchacher
+ * @brief fixed block packet pool
+ * packets are allocated once when received (LoRa or UART) and the FreeRTOS queues carry pointers
+ * a buffer is reference counted, and returns to the pool when released by its last owner
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <Arduino.h>
+#include "packet_pool.h"
+
+static PACKET_BUFFER packet_pool[PACKET_POOL_SIZE] = {};
+static portMUX_TYPE packet_pool_mux = portMUX_INITIALIZER_UNLOCKED;
+// next buffer to check for allocation, spreads the use of the pool
+static uint8_t packet_pool_next = 0;
+static uint8_t packet_pool_free = PACKET_POOL_SIZE;
+static uint8_t packet_pool_min_free = PACKET_POOL_SIZE;
+static uint32_t packet_pool_fail = 0;
+
+/**
+ * @brief allocate a packet buffer, owned by the caller
+ *
+ * @return PACKET_BUFFER* the buffer, NULL if the pool is exhausted
+ */
+PACKET_BUFFER *packet_pool_alloc()
+{
+  PACKET_BUFFER *buffer = NULL;
+  portENTER_CRITICAL(&packet_pool_mux);
+  for (uint8_t i = 0; i < PACKET_POOL_SIZE; i++)
+  {
+    PACKET_BUFFER *candidate = &packet_pool[(packet_pool_next + i) % PACKET_POOL_SIZE];
+    if (0 == candidate->refcount)
+    {
+      buffer = candidate;
+      buffer->refcount = 1;
+      packet_pool_next = (packet_pool_next + i + 1) % PACKET_POOL_SIZE;
+      packet_pool_free--;
+      if (packet_pool_free < packet_pool_min_free)
+      {
+        packet_pool_min_free = packet_pool_free;
+      }
+      break;
+    }
+  }
+  if (NULL == buffer)
+  {
+    packet_pool_fail++;
+  }
+  portEXIT_CRITICAL(&packet_pool_mux);
+  if (NULL != buffer)
+  {
+    buffer->length = 0;
+    buffer->copied = 0;
+    buffer->cycles = 0;
+    buffer->rx_ts = 0;
+  }
+  return buffer;
+}
+
+/**
+ * @brief add an owner to a packet buffer
+ *
+ * @param buffer packet buffer
+ */
+void packet_pool_ref(PACKET_BUFFER *buffer)
+{
+  portENTER_CRITICAL(&packet_pool_mux);
+  buffer->refcount++;
+  portEXIT_CRITICAL(&packet_pool_mux);
+}
+
+/**
+ * @brief release a packet buffer, back to the pool if it was the last owner
+ * releasing a buffer already back to the pool is a double release, caught by configASSERT
+ *
+ * @param buffer packet buffer
+ */
+void packet_pool_release(PACKET_BUFFER *buffer)
+{
+  portENTER_CRITICAL(&packet_pool_mux);
+  configASSERT(buffer->refcount > 0);
+  if (0 == --buffer->refcount)
+  {
+    packet_pool_free++;
+  }
+  portEXIT_CRITICAL(&packet_pool_mux);
+}
+
+/**
+ * @brief get the number of packet buffers available
+ *
+ * @return uint8_t buffers available
+ */
+uint8_t packet_pool_available()
+{
+  return packet_pool_free;
+}
+
+/**
+ * @brief get the lowest number of packet buffers available since boot
+ *
+ * @return uint8_t low watermark
+ */
+uint8_t packet_pool_min_available()
+{
+  return packet_pool_min_free;
+}
+
+/**
+ * @brief get the number of allocations that failed, pool exhausted
+ *
+ * @return uint32_t failed allocations
+ */
+uint32_t packet_pool_alloc_fail_counter()
+{
+  return packet_pool_fail;
+}
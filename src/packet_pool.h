@@ -0,0 +1,56 @@
+/**
+ * @file packet_pool.h
+ * @author mchacher
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include <Arduino.h>
+
+/**
+ * @def PACKET_POOL_SIZE
+ * @brief number of packet buffers shared by the radio, gateway, serial api and uart stages
+ */
+#define PACKET_POOL_SIZE 32
+
+/**
+ * @def PACKET_POOL_HEADROOM
+ * @brief room kept in front of a lora home frame for the serial packet header, no copy to prepend it
+ */
+#define PACKET_POOL_HEADROOM 4
+
+/**
+ * @def PACKET_POOL_BLOCK_SIZE
+ * @brief data size of a packet buffer, a serial packet header followed by the largest lora home frame
+ */
+#define PACKET_POOL_BLOCK_SIZE 144
+
+/**
+ * @brief fixed size packet buffer, handed over from stage to stage by pointer
+ * refcount number of owners, the buffer returns to the pool when the last one releases it
+ * length number of bytes used in data
+ * copied, cycles and rx_ts (us, RxDone) profile the uplink forwarding path, cycles is 0 when not profiled
+ *
+ * @return typedef struct
+ */
+typedef struct
+{
+  uint8_t refcount;
+  uint8_t length;
+  uint16_t copied;
+  uint32_t cycles;
+  uint32_t rx_ts;
+  uint8_t data[PACKET_POOL_BLOCK_SIZE];
+} PACKET_BUFFER;
+
+PACKET_BUFFER *packet_pool_alloc();
+void packet_pool_ref(PACKET_BUFFER *buffer);
+void packet_pool_release(PACKET_BUFFER *buffer);
+uint8_t packet_pool_available();
+uint8_t packet_pool_min_available();
+uint32_t packet_pool_alloc_fail_counter();
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file perf_stats.cpp
+ * @author mchacher
+ * @brief performance counters of the packet forwarding paths
+ * updated by the last stage of a path, read by the system task when the host asks for them
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <Arduino.h>
+#include "perf_stats.h"
+
+static PERF_STATS perf_stats = {};
+static portMUX_TYPE perf_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+// frames written to the uart in the current one second window
+static uint32_t tx_window_frames = 0;
+static unsigned long tx_window_ts = 0;
+
+/**
+ * @brief account an uplink forwarded to the host
+ *
+ * @param bytes_copied bytes copied along the path
+ * @param cycles cpu cycles spent along the path
+ * @param latency_us time from RxDone to the last byte out of the uart
+ */
+void perf_stats_uplink(uint32_t bytes_copied, uint32_t cycles, uint32_t latency_us)
+{
+  portENTER_CRITICAL(&perf_stats_mux);
+  perf_stats.uplink_counter++;
+  perf_stats.uplink_bytes_copied += bytes_copied;
+  perf_stats.uplink_cycles += cycles;
+  perf_stats.uplink_latency_us += latency_us;
+  if (latency_us > perf_stats.uplink_latency_max_us)
+  {
+    perf_stats.uplink_latency_max_us = latency_us;
+  }
+  portEXIT_CRITICAL(&perf_stats_mux);
+}
+
+/**
+ * @brief account a pipeline task wake up
+ *
+ */
+void perf_stats_wakeup()
+{
+  portENTER_CRITICAL(&perf_stats_mux);
+  perf_stats.wakeup_counter++;
+  portEXIT_CRITICAL(&perf_stats_mux);
+}
+
+/**
+ * @brief account a burst of frames written to the uart
+ *
+ * @param frames number of frames of the burst
+ */
+void perf_stats_tx_burst(uint32_t frames)
+{
+  unsigned long now = millis();
+  portENTER_CRITICAL(&perf_stats_mux);
+  perf_stats.tx_frame_counter += frames;
+  perf_stats.tx_burst_counter++;
+  if ((now - tx_window_ts) >= 1000)
+  {
+    tx_window_ts = now;
+    tx_window_frames = 0;
+  }
+  tx_window_frames += frames;
+  if (tx_window_frames > perf_stats.tx_frames_per_s_max)
+  {
+    perf_stats.tx_frames_per_s_max = tx_window_frames;
+  }
+  portEXIT_CRITICAL(&perf_stats_mux);
+}
+
+/**
+ * @brief get a copy of the performance counters
+ *
+ * @param stats pointer used to return the counters
+ */
+void perf_stats_get(PERF_STATS *stats)
+{
+  portENTER_CRITICAL(&perf_stats_mux);
+  *stats = perf_stats;
+  portEXIT_CRITICAL(&perf_stats_mux);
+}
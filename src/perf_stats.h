@@ -0,0 +1,41 @@
+/**
+ * @file perf_stats.h
+ * @author mchacher
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include <Arduino.h>
+
+/**
+ * @brief forwarding path performance since boot
+ * uplink_bytes_copied bytes copied by the dongle software from RxDone to the uart, radio and uart drivers excluded
+ * uplink_cycles cpu cycles spent on the uplink forwarding path, waiting in queues excluded
+ * uplink_latency_us time from RxDone to the last byte out of the uart, estimated from the bytes queued and the baud rate
+ * wakeup_counter times a pipeline task (or the reactor) was woken up, about one context switch each
+ * tx_frame_counter frames written to the uart, in tx_burst_counter bursts, tx_frames_per_s_max most frames written within a second
+ *
+ * @return typedef struct
+ */
+typedef struct
+{
+  uint32_t uplink_counter;
+  uint64_t uplink_bytes_copied;
+  uint64_t uplink_cycles;
+  uint64_t uplink_latency_us;
+  uint32_t uplink_latency_max_us;
+  uint32_t wakeup_counter;
+  uint32_t tx_frame_counter;
+  uint32_t tx_burst_counter;
+  uint32_t tx_frames_per_s_max;
+} PERF_STATS;
+
+void perf_stats_uplink(uint32_t bytes_copied, uint32_t cycles, uint32_t latency_us);
+void perf_stats_wakeup();
+void perf_stats_tx_burst(uint32_t frames);
+void perf_stats_get(PERF_STATS *stats);
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * @file reactor.cpp
+ * @author mchacher
+ * @brief event queue of the single reactor task (SINGLE_REACTOR)
+ * an event is posted at most once until taken by the reactor, so the queue never overflows
+ * and posting from the reactor itself never blocks
+ * the UART driver event queue is added to the same queue set, received bytes wake the reactor up as UART_RX
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <Arduino.h>
+#include "reactor.h"
+#include "uart.h"
+
+static QueueHandle_t reactor_queue = NULL;
+static QueueHandle_t reactor_uart_queue = NULL;
+static QueueSetHandle_t reactor_set = NULL;
+// bit set for each event in the queue
+static uint32_t reactor_pending = 0;
+static portMUX_TYPE reactor_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief create the event queue, before any event is posted
+ *
+ */
+void reactor_init()
+{
+  reactor_set = xQueueCreateSet(REACTOR_EVENT_COUNT + UART_EVENT_QUEUE_SIZE);
+  reactor_queue = xQueueCreate(REACTOR_EVENT_COUNT, sizeof(uint8_t));
+  xQueueAddToSet(reactor_queue, reactor_set);
+}
+
+/**
+ * @brief add the UART driver event queue to the events waited for, while still empty
+ * a UART driver event is reported as UART_RX, and left in its queue for uart_rx_process
+ *
+ * @param uart_queue UART driver event queue, of UART_EVENT_QUEUE_SIZE items
+ */
+void reactor_attach_uart(QueueHandle_t uart_queue)
+{
+  reactor_uart_queue = uart_queue;
+  xQueueAddToSet(uart_queue, reactor_set);
+}
+
+/**
+ * @brief post an event to the reactor, no effect if already pending
+ *
+ * @param event event
+ */
+void reactor_post(REACTOR_EVENT event)
+{
+  if (NULL == reactor_queue)
+  {
+    return;
+  }
+  portENTER_CRITICAL(&reactor_mux);
+  bool pending = reactor_pending & (1 << event);
+  reactor_pending |= (1 << event);
+  portEXIT_CRITICAL(&reactor_mux);
+  if (!pending)
+  {
+    uint8_t item = event;
+    xQueueSendToBack(reactor_queue, &item, 0);
+  }
+}
+
+/**
+ * @brief post an event to the reactor from an interrupt handler, no effect if already pending
+ *
+ * @param event event
+ * @param higher_priority_task_woken set to pdTRUE if the reactor must run when leaving the interrupt
+ */
+void IRAM_ATTR reactor_post_from_isr(REACTOR_EVENT event, BaseType_t *higher_priority_task_woken)
+{
+  if (NULL == reactor_queue)
+  {
+    return;
+  }
+  portENTER_CRITICAL_ISR(&reactor_mux);
+  bool pending = reactor_pending & (1 << event);
+  reactor_pending |= (1 << event);
+  portEXIT_CRITICAL_ISR(&reactor_mux);
+  if (!pending)
+  {
+    uint8_t item = event;
+    xQueueSendFromISR(reactor_queue, &item, higher_priority_task_woken);
+  }
+}
+
+/**
+ * @brief wait for the next event
+ * UART_RX is reported once per UART driver event, uart_rx_process must then take it
+ *
+ * @param event pointer used to return the event
+ * @param wait max time to wait
+ * @return true if an event was taken
+ * @return false on timeout
+ */
+bool reactor_wait(REACTOR_EVENT *event, TickType_t wait)
+{
+  uint8_t item;
+  QueueSetMemberHandle_t member = xQueueSelectFromSet(reactor_set, wait);
+  if (NULL == member)
+  {
+    return false;
+  }
+  if (member == reactor_uart_queue)
+  {
+    *event = REACTOR_EVENT_UART_RX;
+    return true;
+  }
+  if (pdTRUE != xQueueReceive(reactor_queue, &item, 0))
+  {
+    return false;
+  }
+  portENTER_CRITICAL(&reactor_mux);
+  reactor_pending &= ~(1 << item);
+  portEXIT_CRITICAL(&reactor_mux);
+  *event = (REACTOR_EVENT)item;
+  return true;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file reactor.h
+ * @author mchacher
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <Arduino.h>
+
+/**
+ * @brief events multiplexed by the single reactor task (SINGLE_REACTOR)
+ * UART_RX UART driver event (bytes received), UART_TX buffer queued for the UART, RADIO DIO0 interrupt or LoRa tx request
+ */
+typedef enum
+{
+  REACTOR_EVENT_UART_RX,
+  REACTOR_EVENT_UART_TX,
+  REACTOR_EVENT_RADIO,
+  REACTOR_EVENT_COUNT
+} REACTOR_EVENT;
+
+void reactor_init();
+void reactor_attach_uart(QueueHandle_t uart_queue);
+void reactor_post(REACTOR_EVENT event);
+void reactor_post_from_isr(REACTOR_EVENT event, BaseType_t *higher_priority_task_woken);
+bool reactor_wait(REACTOR_EVENT *event, TickType_t wait);
+
+#endif
@@ -7,6 +7,7 @@
  * - log: simply send a text information to the dongle (not used)
  * - echo: for test purpose, dongle can send an echo message, that is echo to the host
  * - system: different types of system messages (heartbeat, node info (meaning information about connected equipment, more to come ...)
+ * packets received are routed by type, to a registered handler or queue, by a dispatcher running in the uart rx stage
  * 
  * @copyright Copyright (c) 2023
  * 
@@ -14,10 +15,106 @@
 #include <Arduino.h>
 #include "serial_api.h"
 #include "uart.h"
+#include "packet_pool.h"
 
 
 static uint16_t _packet_id = 0x0000;
 QueueHandle_t sys_packet_queue;
+QueueHandle_t lora_home_packet_queue;
+
+/**
+ * @brief route of a serial msg type, to a handler or a queue, unknown type if none
+ * 
+ */
+typedef struct
+{
+  SERIAL_API_HANDLER handler;
+  QueueHandle_t queue;
+} SERIAL_API_ROUTE;
+
+static SERIAL_API_ROUTE serial_api_routes[SERIAL_MSG_TYPE_COUNT] = {};
+
+// serial_api_unknown_counter - each time a packet of an unknown or unregistered type is received
+uint32_t serial_api_unknown_counter = 0;
+// serial_api_drop_counter - each time a packet is dropped because its queue is full, or by its handler
+uint32_t serial_api_drop_counter = 0;
+
+static_assert(sizeof(SERIAL_PACKET_HEADER) == PACKET_POOL_HEADROOM, "serial packet header must fit the packet buffer headroom");
+
+/**
+ * @brief fill in the serial packet header in front of the data, and push the buffer to the uart
+ *
+ * @param buffer packet buffer, data starting at PACKET_POOL_HEADROOM, handed over
+ * @param type serial msg type
+ * @param size data size
+ * @param link link settings to switch to once sent, NULL to keep them
+ * @return true if queued for transmission
+ * @return false if the uart tx queue is full
+ */
+static bool serial_api_send(PACKET_BUFFER *buffer, SERIAL_MSG_TYPE type, uint8_t size, const UART_LINK_SETTINGS *link = NULL)
+{
+  SERIAL_PACKET *sp = (SERIAL_PACKET *)buffer->data;
+  sp->header.packet_id = _packet_id++;
+  sp->header.type = type;
+  sp->header.data_length = size;
+  buffer->length = sizeof(SERIAL_PACKET_HEADER) + size;
+  if (NULL != link)
+  {
+    return uart_put_tx_buffer_switch(buffer, link);
+  }
+  return uart_put_tx_buffer(buffer);
+}
+
+/**
+ * @brief gather data fragments in a new packet buffer, right behind the header, and send it over uart
+ * no staging SERIAL_PACKET, each fragment is copied once, the frame is encoded once by the uart tx stage
+ *
+ * @param type serial msg type
+ * @param iov data fragments, in order
+ * @param count number of fragments
+ * @param link link settings to switch to once sent, NULL to keep them
+ * @return true if queued for transmission
+ * @return false if too large, no packet buffer available or the uart tx queue is full
+ */
+bool serial_api_sendv(SERIAL_MSG_TYPE type, const SERIAL_API_IOV *iov, uint8_t count, const UART_LINK_SETTINGS *link)
+{
+  uint32_t size = 0;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    size += iov[i].length;
+  }
+  if (size > (PACKET_POOL_BLOCK_SIZE - PACKET_POOL_HEADROOM))
+  {
+    return false;
+  }
+  PACKET_BUFFER *buffer = packet_pool_alloc();
+  if (NULL == buffer)
+  {
+    return false;
+  }
+  uint8_t *data = &buffer->data[PACKET_POOL_HEADROOM];
+  for (uint8_t i = 0; i < count; i++)
+  {
+    memcpy(data, iov[i].base, iov[i].length);
+    data += iov[i].length;
+  }
+  return serial_api_send(buffer, type, size, link);
+}
+
+/**
+ * @brief copy data in a new packet buffer and send it over uart
+ *
+ * @param type serial msg type
+ * @param data data to send
+ * @param size data size
+ * @return true if queued for transmission
+ * @return false if no packet buffer available or the uart tx queue is full
+ */
+static bool serial_api_send_copy(SERIAL_MSG_TYPE type, const uint8_t *data, uint8_t size)
+{
+  SERIAL_API_IOV iov = {data, size};
+  return serial_api_sendv(type, &iov, 1);
+}
 
 /**
  * @brief send a log message over uart
@@ -26,32 +123,18 @@ QueueHandle_t sys_packet_queue;
  */
 void serial_api_send_log_message(char *message)
 {
-  SERIAL_PACKET_HEADER sph = {0};
-  sph.packet_id = _packet_id++;
-  sph.type = SERIAL_MSG_TYPE_LOG;
-  sph.data_length = strlen(message);
-  SERIAL_PACKET sp = {0};
-  sp.header = sph;
-  memcpy(sp.data, message, strlen(message));
-  uart_put_tx_buffer((uint8_t *)&sp, sph.data_length + sizeof(sph));
+  serial_api_send_copy(SERIAL_MSG_TYPE_LOG, (uint8_t *)message, strlen(message));
 }
 
 /**
- * @brief send a lora home packet over uart
+ * @brief send a lora home packet over uart, no copy
  * 
- * @param packet the lora home packet
+ * @param packet packet buffer holding the lora home packet at PACKET_POOL_HEADROOM, handed over
  * @param size packet size
  */
-void serial_api_send_lora_home_packet(uint8_t *packet, uint8_t size)
+void serial_api_send_lora_home_packet(PACKET_BUFFER *packet, uint8_t size)
 {
-  SERIAL_PACKET_HEADER sph = {0};
-  sph.packet_id = _packet_id++;
-  sph.type = SERIAL_MSG_TYPE_LORA_HOME;
-  sph.data_length = size;
-  SERIAL_PACKET sp = {0};
-  sp.header = sph;
-  memcpy(sp.data, packet, size);
-  uart_put_tx_buffer((uint8_t *)&sp, sph.data_length + sizeof(sph));
+  serial_api_send(packet, SERIAL_MSG_TYPE_LORA_HOME, size);
 }
 
 /**
@@ -59,41 +142,46 @@ void serial_api_send_lora_home_packet(uint8_t *packet, uint8_t size)
  * 
  * @param packet the lora home system message
  * @param size packet size
+ * @return true if queued for transmission
+ * @return false if the uart tx queue is full
+ */
+bool serial_api_send_sys_packet(uint8_t *packet, uint8_t size)
+{
+  return serial_api_send_copy(SERIAL_MSG_TYPE_SYS, packet, size);
+}
+
+/**
+ * @brief send a dongle system message from its type and payload, gathered without staging a DONGLE_SYS_PACKET
+ * with link settings, messages sent afterwards use the new baud rate and framing
+ * 
+ * @param sys_type system packet type
+ * @param payload system packet payload
+ * @param size payload size
+ * @param link link settings to switch to once sent, NULL to keep them
+ * @return true if queued for transmission
+ * @return false if no packet buffer available or the uart tx queue is full, link settings unchanged
  */
-void serial_api_send_sys_packet(uint8_t *packet, uint8_t size)
+bool serial_api_send_sys_payload(uint8_t sys_type, const void *payload, uint8_t size, const UART_LINK_SETTINGS *link)
 {
-  SERIAL_PACKET_HEADER sph = {0};
-  sph.packet_id = _packet_id++;
-  sph.type = SERIAL_MSG_TYPE_SYS;
-  sph.data_length = size;
-  SERIAL_PACKET sp = {0};
-  sp.header = sph;
-  memcpy(sp.data, packet, size);
-  uart_put_tx_buffer((uint8_t *)&sp, sph.data_length + sizeof(sph));
+  SERIAL_API_IOV iov[2] = {{&sys_type, sizeof(sys_type)}, {payload, size}};
+  return serial_api_sendv(SERIAL_MSG_TYPE_SYS, iov, 2, link);
 }
 
 
 /**
  * @brief get lora home packet is any available
  * 
- * @param packet pointer to the packet received
+ * @param packet pointer used to return the packet buffer, holding a SERIAL_PACKET, to be released by the caller
+ * @param wait max time to wait for a packet
  * @return true if received
  * @return false 
  */
-bool serial_api_get_lora_home_packet(uint8_t *packet)
+bool serial_api_get_lora_home_packet(PACKET_BUFFER **packet, TickType_t wait)
 {
-  while (uart_get_rx_buffer(packet))
+  BaseType_t anymsg = xQueueReceive(lora_home_packet_queue, packet, wait);
+  if (pdTRUE == anymsg)
   {
-    SERIAL_PACKET *sp = (SERIAL_PACKET*)packet;
-    if (sp->header.type == SERIAL_MSG_TYPE_LORA_HOME)
-    {
-      return true;
-    }
-    // else put the packet in the system queue
-    else if(sp->header.type == SERIAL_MSG_TYPE_SYS)
-    {
-      xQueueSendToBack(sys_packet_queue, packet, 0);
-    }
+    return true;
   }
   return false;
 }
@@ -101,13 +189,14 @@ bool serial_api_get_lora_home_packet(uint8_t *packet)
 /**
  * @brief get dongle system packet if any available
  * 
- * @param packet 
+ * @param packet pointer used to return the packet buffer, holding a SERIAL_PACKET, to be released by the caller
+ * @param wait max time to wait for a packet
  * @return true 
  * @return false 
  */
-bool serial_api_get_sys_dongle_packet(uint8_t *packet)
+bool serial_api_get_sys_dongle_packet(PACKET_BUFFER **packet, TickType_t wait)
 {
-  BaseType_t anymsg = xQueueReceive(sys_packet_queue, packet, 0);
+  BaseType_t anymsg = xQueueReceive(sys_packet_queue, packet, wait);
   if (pdTRUE == anymsg)
   {
     return true;
@@ -116,12 +205,147 @@ bool serial_api_get_sys_dongle_packet(uint8_t *packet)
 }
 
 
+/**
+ * @brief register the handler of a serial msg type, replacing its queue if any
+ * to be called before the uart rx stage starts
+ * 
+ * @param type serial msg type
+ * @param handler handler
+ */
+void serial_api_register_handler(SERIAL_MSG_TYPE type, SERIAL_API_HANDLER handler)
+{
+  serial_api_routes[type].handler = handler;
+  serial_api_routes[type].queue = NULL;
+}
+
+/**
+ * @brief register the queue a serial msg type is pushed to, replacing its handler if any
+ * to be called before the uart rx stage starts
+ * 
+ * @param type serial msg type
+ * @param queue queue of PACKET_BUFFER pointers
+ */
+void serial_api_register_queue(SERIAL_MSG_TYPE type, QueueHandle_t queue)
+{
+  serial_api_routes[type].handler = NULL;
+  serial_api_routes[type].queue = queue;
+}
+
+/**
+ * @brief route a packet received on the uart by its type, right away in the uart rx stage
+ * a control packet never waits behind a stalled data packet
+ * 
+ * @param packet packet buffer holding a SERIAL_PACKET, handed over
+ */
+static void serial_api_dispatch(PACKET_BUFFER *packet)
+{
+  SERIAL_PACKET *sp = (SERIAL_PACKET *)packet->data;
+  if ((packet->length < sizeof(SERIAL_PACKET_HEADER)) || (sp->header.type >= SERIAL_MSG_TYPE_COUNT))
+  {
+    serial_api_unknown_counter++;
+    packet_pool_release(packet);
+    return;
+  }
+  SERIAL_API_ROUTE *route = &serial_api_routes[sp->header.type];
+  if (NULL != route->handler)
+  {
+    if (!route->handler(packet))
+    {
+      serial_api_drop_counter++;
+    }
+    return;
+  }
+  if (NULL == route->queue)
+  {
+    serial_api_unknown_counter++;
+  }
+  else if (pdTRUE == xQueueSendToBack(route->queue, &packet, 0))
+  {
+    return;
+  }
+  else
+  {
+    serial_api_drop_counter++;
+  }
+  packet_pool_release(packet);
+}
+
 /**
  * @brief initialize serial api
+ * system and lora home packets are routed to their own queue
  * 
  */
 void serial_api_init(void)
 {
   // Create a queue to hold messages
-  sys_packet_queue = xQueueCreate(UART_RX_FIFO_ITEMS, UART_RX_BUFFER_SIZE * sizeof(uint8_t));
-}
\ No newline at end of file
+  sys_packet_queue = xQueueCreate(UART_RX_FIFO_ITEMS, sizeof(PACKET_BUFFER *));
+  lora_home_packet_queue = xQueueCreate(UART_RX_FIFO_ITEMS, sizeof(PACKET_BUFFER *));
+  serial_api_register_queue(SERIAL_MSG_TYPE_SYS, sys_packet_queue);
+  serial_api_register_queue(SERIAL_MSG_TYPE_LORA_HOME, lora_home_packet_queue);
+  uart_set_rx_handler(serial_api_dispatch);
+}
+
+#ifdef SERIAL_API_BENCHMARK
+/**
+ * @brief cycles of one system packet send, staged in a DONGLE_SYS_PACKET or gathered from its fragments
+ * encoding is done by the uart tx stage and not counted, the uart is drained after each send
+ *
+ * @param gathered true to send with serial_api_send_sys_payload, false to stage a DONGLE_SYS_PACKET first
+ * @param payload payload to send
+ * @param size payload size
+ * @return uint32_t cycles per send
+ */
+static uint32_t serial_api_benchmark_sys(bool gathered, const uint8_t *payload, uint8_t size)
+{
+  const uint16_t iterations = 200;
+  uint32_t cycles = 0;
+  for (uint16_t i = 0; i < iterations; i++)
+  {
+    uint32_t start = ESP.getCycleCount();
+    if (gathered)
+    {
+      serial_api_send_sys_payload(0, payload, size);
+    }
+    else
+    {
+      DONGLE_SYS_PACKET packet;
+      packet.sys_type = 0;
+      memcpy(packet.payload, payload, size);
+      serial_api_send_sys_packet((uint8_t *)&packet, sizeof(packet.sys_type) + size);
+    }
+    cycles += ESP.getCycleCount() - start;
+    uart_tx_process();
+  }
+  return cycles / iterations;
+}
+
+/**
+ * @brief compare staged and gathered sends of a perf stats sized system packet, with sys type 0 ignored by the host
+ * and measure the send of an uplink, handed over without copy
+ * cycles per uplink forwarded end to end are reported by the perf stats
+ *
+ */
+void serial_api_benchmark(void)
+{
+  const uint8_t size = sizeof(DONGLE_PERF_STATS_PACKET_PAYLOAD);
+  uint8_t payload[size];
+  char log[128];
+
+  memset(payload, 0, size);
+  uint32_t staged = serial_api_benchmark_sys(false, payload, size);
+  uint32_t gathered = serial_api_benchmark_sys(true, payload, size);
+  uint32_t uplink = 0;
+  PACKET_BUFFER *buffer = packet_pool_alloc();
+  if (NULL != buffer)
+  {
+    memset(&buffer->data[PACKET_POOL_HEADROOM], 0, size);
+    uint32_t start = ESP.getCycleCount();
+    serial_api_send(buffer, SERIAL_MSG_TYPE_NULL, size);
+    uplink = ESP.getCycleCount() - start;
+    uart_tx_process();
+  }
+  snprintf(log, sizeof(log), "serial send of %u bytes: staged %lu cycles, gathered %lu cycles, uplink %lu cycles", size,
+           (unsigned long)staged, (unsigned long)gathered, (unsigned long)uplink);
+  serial_api_send_log_message(log);
+}
+#endif
@@ -9,6 +9,8 @@
 #define SERIAL_API_H
 
 #include "lora_home_configuration.h"
+#include "packet_pool.h"
+#include "uart.h"
 
 #define DATA_BUFFER_SIZE 128
 
@@ -24,9 +26,32 @@ typedef enum
   SERIAL_MSG_TYPE_NULL = 0,
   SERIAL_MSG_TYPE_LOG = 1,
   SERIAL_MSG_TYPE_SYS = 2,
-  SERIAL_MSG_TYPE_LORA_HOME = 3
+  SERIAL_MSG_TYPE_LORA_HOME = 3,
+  SERIAL_MSG_TYPE_COUNT
 } SERIAL_MSG_TYPE;
 
+/**
+ * @brief handler of a serial msg type, called by the dispatcher in the uart rx stage, must not block
+ * takes the packet buffer over
+ * 
+ * @return false if the packet was dropped
+ */
+typedef bool (*SERIAL_API_HANDLER)(PACKET_BUFFER *packet);
+
+/**
+ * @brief fragment of a serial packet data, gathered with the other fragments behind the header
+ * 
+ * @return typedef struct 
+ */
+typedef struct
+{
+  const void *base;
+  uint8_t length;
+} SERIAL_API_IOV;
+
+// uncomment to compare staged and gathered system packet sends at boot, reported as a log message
+// #define SERIAL_API_BENCHMARK
+
 /**
  * @brief serial packet header
  * 
@@ -63,6 +88,17 @@ typedef enum
   TYPE_SYS_GET_ALL_SETTINGS = 5,
   TYPE_SYS_INFO_ALL_SETTINGS = 6,
   TYPE_SYS_SET_LORA_HOME_NETWORK_ID = 7,
+  TYPE_SYS_GET_NODE_STATS = 8,
+  TYPE_SYS_INFO_NODE_STATS = 9,
+  TYPE_SYS_GET_CHANNEL_STATS = 10,
+  TYPE_SYS_INFO_CHANNEL_STATS = 11,
+  TYPE_SYS_GET_PERF_STATS = 12,
+  TYPE_SYS_INFO_PERF_STATS = 13,
+  TYPE_SYS_SET_BAUD_RATE = 14,
+  TYPE_SYS_INFO_BAUD_RATE = 15,
+  TYPE_SYS_SET_FRAMING = 16,
+  TYPE_SYS_INFO_FRAMING = 17,
+  TYPE_SYS_INFO_CREDITS = 18,
   TYPE_SYS_RESET = 254
 } TYPE_SYS;
 
@@ -77,8 +113,25 @@ typedef struct __attribute__((__packed__))
   uint8_t payload[DATA_BUFFER_SIZE];
 } DONGLE_SYS_PACKET;
 
+/**
+ * @brief downlink flow control, payload of credits system packet, sent each time a credit is returned
+ * the host may send a downlink as long as the downlinks it sent since boot are fewer than credit_limit
+ * downlink_counter downlinks received since boot, the host resyncs its own count on it if downlinks were lost on the uart
+ * downlink_drop_counter downlinks dropped with their tx queue full, uart_rx_drop_counter uart messages dropped
+ *
+ * @return typedef struct
+ */
+typedef struct __attribute__((__packed__))
+{
+  uint32_t downlink_counter;
+  uint32_t credit_limit;
+  uint32_t downlink_drop_counter;
+  uint32_t uart_rx_drop_counter;
+} DONGLE_CREDITS_PACKET_PAYLOAD;
+
 /**
  * @brief payload of heartbeat system packet
+ * airtime_budget airtime (ms) left in the duty cycle window of the active channel, in scan mode the least left over the scan set
  * 
  * @return typedef struct 
  */
@@ -87,6 +140,8 @@ typedef struct __attribute__((__packed__))
   uint32_t rx_counter;
   uint32_t tx_counter;
   uint32_t err_counter;
+  uint32_t airtime_budget;
+  DONGLE_CREDITS_PACKET_PAYLOAD credits;
 } DONGLE_HEARTBEAT_PACKET_PAYLOAD;
 
 /**
@@ -103,11 +158,166 @@ typedef struct __attribute__((__packed__))
   uint16_t lora_home_network_id;
 } DONGLE_ALL_SETTINGS_PACKET_PAYLOAD;
 
+/**
+ * @brief link statistics of a node
+ * rssi in dBm, snr in 0.25 dB, channel frequency the node was last heard on, last_seen_age in ms since the last frame received
+ * lost_counter estimated from gaps in the lora home packet counter
+ *
+ * @return typedef struct
+ */
+typedef struct __attribute__((__packed__))
+{
+  uint8_t node_id;
+  int16_t rssi_last;
+  int16_t rssi_avg;
+  int8_t snr_last;
+  int8_t snr_avg;
+  uint32_t channel;
+  uint32_t last_seen_age;
+  uint32_t uplink_counter;
+  uint32_t lost_counter;
+} DONGLE_NODE_STATS;
+
+#define NODE_STATS_PER_PACKET 5
+
+/**
+ * @brief payload of node stats system packet
+ * the table is streamed over several packets, sequence starting at 0, last set on the final one
+ *
+ * @return typedef struct
+ */
+typedef struct __attribute__((__packed__))
+{
+  uint8_t sequence;
+  uint8_t last;
+  uint8_t count;
+  DONGLE_NODE_STATS nodes[NODE_STATS_PER_PACKET];
+} DONGLE_NODE_STATS_PACKET_PAYLOAD;
+
+/**
+ * @brief activity of a channel of the scan set
+ * scan_hit_counter channel activity detected while scanning, rx_counter valid frames received
+ * foreign_counter valid frames of other networks received, scan_miss_counter channel activity without valid frame
+ * (noise, CRC errors, or with the sync word filter frames of other networks dropped by the transceiver)
+ * airtime_budget airtime (ms) left in the duty cycle window of the sub-band of the channel
+ *
+ * @return typedef struct
+ */
+typedef struct __attribute__((__packed__))
+{
+  uint32_t channel;
+  uint32_t scan_hit_counter;
+  uint32_t rx_counter;
+  uint32_t foreign_counter;
+  uint32_t scan_miss_counter;
+  uint32_t airtime_budget;
+} DONGLE_CHANNEL_STATS;
+
+/**
+ * @brief payload of channel stats system packet
+ * sync_word of the transceiver, derived from the network id with the sync word filter
+ *
+ * @return typedef struct
+ */
+typedef struct __attribute__((__packed__))
+{
+  uint8_t count;
+  DONGLE_CHANNEL_STATS channels[LORA_SCAN_CHANNEL_COUNT];
+  uint8_t sync_word;
+} DONGLE_CHANNEL_STATS_PACKET_PAYLOAD;
+
+/**
+ * @brief payload of perf stats system packet
+ * bytes copied, cpu cycles and latency (us, RxDone to last uart byte) per uplink forwarded to the host, averaged since boot
+ * packet buffers available now, lowest since boot and failed allocations
+ * pipeline mode (1 single reactor), stack reserved for the pipeline and log tasks, task wake ups (about one context switch each), free heap now and lowest since boot
+ * frames written to the uart, in bursts, and most frames written within a second
+ * messages received of an unknown type, and dropped by the dispatcher (queue full or handler)
+ * time to load the configuration at boot, configuration saves requested by the host and flash writes they caused
+ * time the transceiver did not listen during the last lora settings change
+ *
+ * @return typedef struct
+ */
+typedef struct __attribute__((__packed__))
+{
+  uint32_t uplink_counter;
+  uint32_t uplink_bytes_copied;
+  uint32_t uplink_cycles;
+  uint32_t uplink_latency_us;
+  uint32_t uplink_latency_max_us;
+  uint8_t pool_available;
+  uint8_t pool_min_available;
+  uint32_t pool_alloc_fail_counter;
+  uint8_t single_reactor;
+  uint32_t stack_reserved;
+  uint32_t wakeup_counter;
+  uint32_t free_heap;
+  uint32_t min_free_heap;
+  uint32_t tx_frame_counter;
+  uint32_t tx_burst_counter;
+  uint32_t tx_frames_per_s_max;
+  uint32_t dispatch_unknown_counter;
+  uint32_t dispatch_drop_counter;
+  uint32_t config_load_us;
+  uint32_t config_save_counter;
+  uint32_t config_write_counter;
+  uint32_t retune_us;
+} DONGLE_PERF_STATS_PACKET_PAYLOAD;
+
+/**
+ * @brief status of a link change, baud rate or framing
+ * ACCEPTED the dongle switches once this reply is sent, the host must switch as well and send an echo to confirm
+ * REJECTED setting not supported or change ongoing, CONFIRMED echo received with the new setting, now persistent
+ * FALLBACK no echo received in time, the dongle switches back to the previous setting once this reply is sent
+ *
+ */
+typedef enum
+{
+  LINK_CHANGE_ACCEPTED = 0,
+  LINK_CHANGE_REJECTED = 1,
+  LINK_CHANGE_CONFIRMED = 2,
+  LINK_CHANGE_FALLBACK = 3
+} LINK_CHANGE_STATUS;
+
+/**
+ * @brief payload of baud rate system packets
+ * baud rate requested by the host, or baud rate the dongle falls back to
+ *
+ * @return typedef struct
+ */
+typedef struct __attribute__((__packed__))
+{
+  uint32_t baud_rate;
+  uint8_t status;
+} DONGLE_BAUD_RATE_PACKET_PAYLOAD;
+
+/**
+ * @brief payload of framing system packets
+ * framing (UART_FRAMING) requested by the host, or framing the dongle falls back to
+ *
+ * @return typedef struct
+ */
+typedef struct __attribute__((__packed__))
+{
+  uint8_t framing;
+  uint8_t status;
+} DONGLE_FRAMING_PACKET_PAYLOAD;
+
+extern uint32_t serial_api_unknown_counter;
+extern uint32_t serial_api_drop_counter;
+
+void serial_api_register_handler(SERIAL_MSG_TYPE type, SERIAL_API_HANDLER handler);
+void serial_api_register_queue(SERIAL_MSG_TYPE type, QueueHandle_t queue);
 void serial_api_send_log_message(char *msg);
-void serial_api_send_sys_packet(uint8_t *packet, uint8_t size);
-void serial_api_send_lora_home_packet(uint8_t *packet, uint8_t size);
-bool serial_api_get_lora_home_packet(uint8_t *packet);
-bool serial_api_get_sys_dongle_packet(uint8_t *packet);
+bool serial_api_send_sys_packet(uint8_t *packet, uint8_t size);
+bool serial_api_send_sys_payload(uint8_t sys_type, const void *payload, uint8_t size, const UART_LINK_SETTINGS *link = NULL);
+bool serial_api_sendv(SERIAL_MSG_TYPE type, const SERIAL_API_IOV *iov, uint8_t count, const UART_LINK_SETTINGS *link = NULL);
+void serial_api_send_lora_home_packet(PACKET_BUFFER *packet, uint8_t size);
+bool serial_api_get_lora_home_packet(PACKET_BUFFER **packet, TickType_t wait);
+bool serial_api_get_sys_dongle_packet(PACKET_BUFFER **packet, TickType_t wait);
 void serial_api_init(void);
+#ifdef SERIAL_API_BENCHMARK
+void serial_api_benchmark(void);
+#endif
 
 #endif
@@ -4,7 +4,9 @@
  * @brief  UART data link layer
  * send and receive data over UART
  * use bytestuffing with START, STOP and ESC bytes to ensure the integrity and correctness of the transmitted data
- * 2 taks are used: one for Rx and one for Tx
+ * or COBS framing, negotiated with the host, for a constant overhead
+ * 2 taks are used: one for Rx and one for Tx, or the reactor task with SINGLE_REACTOR
+ * the ESP-IDF UART driver buffers received bytes in a ring buffer, read and decoded in chunks
  * 
  * @copyright Copyright (c) 2023
  * 
@@ -12,31 +14,109 @@
 #include <Arduino.h>
 #include <uart.h>
 #include <esp_system.h>
+#include <esp_timer.h>
+#include "perf_stats.h"
+#include "dongle_configuration.h"
+#include "reactor.h"
+#include <driver/uart.h>
+#if defined(UART_FRAMING_BENCHMARK) || defined(UART_TX_BENCHMARK)
+#include "serial_api.h"
+#endif
 
 /**
- * @brief UART rx queue
+ * @brief UART rx queue, of PACKET_BUFFER pointers
  * 
  */
 QueueHandle_t rx_uart_queue;
 
 /**
- * @brief UART tx queue
+ * @brief UART tx queue, of PACKET_BUFFER pointers
  * 
  */
 QueueHandle_t tx_uart_queue;
 
+// uart_rx_drop_counter - each time a message received is dropped: no packet buffer, rx queue full, too long or bytes lost
+uint32_t uart_rx_drop_counter = 0;
+
+/**
+ * @brief handler of the messages received, NULL to push them to the rx queue
+ * 
+ */
+static UART_RX_HANDLER uart_rx_handler = NULL;
+
+/**
+ * @brief UART driver event queue: data received (rx FIFO threshold or rx timeout), STOP flag detected, overflows
+ * 
+ */
+static QueueHandle_t uart_event_queue = NULL;
+
+#define UART_PORT UART_NUM_0
+
+/**
+ * @brief baud rates the host can switch to
+ * 
+ */
+static const uint32_t UART_BAUD_RATES[] = {115200, 230400, 460800, 921600, 1000000, 1500000, 2000000};
+
+/**
+ * @brief buffer after which the link settings are switched, NULL if none
+ * 
+ */
+static PACKET_BUFFER *volatile uart_switch_buffer = NULL;
+static UART_LINK_SETTINGS uart_switch_link;
+
+/**
+ * @brief baud rate in use, and estimated time stamp (us) the last byte written to the UART driver is out
+ * 
+ */
+static uint32_t uart_baud_rate = UART_BAUD_RATE;
+static uint32_t uart_tx_drain_ts = 0;
+
+/**
+ * @brief framing in use, switched by the tx stage
+ * 
+ */
+static volatile UART_FRAMING uart_framing = UART_FRAMING_STUFFING;
+
+// the encoded frames are COBS single blocks, the delimiter never sent inside a message
+static_assert(PACKET_POOL_BLOCK_SIZE < 254, "COBS single block encoding requires messages shorter than 254 bytes");
+
+/**
+ * @brief decoder state, kept across chunks
+ * 
+ */
+static UART_FRAMING rx_framing = UART_FRAMING_STUFFING;
+static uint8_t rx_cobs_code = 0;
+static UART_RX_STATE rx_state = RX_IDLE;
+static uint16_t rx_index = 0;
+static bool rx_esc_next_byte = false;
+static PACKET_BUFFER *rx_buffer = NULL;
+
 #define WHITE_LED 25
 
+/**
+ * @brief hand the messages received over to a handler, instead of the rx queue
+ * to be set before the rx stage starts
+ * 
+ * @param handler handler, NULL for the rx queue
+ */
+void uart_set_rx_handler(UART_RX_HANDLER handler)
+{
+  uart_rx_handler = handler;
+}
+
 /**
  * @brief if any available in the uart rx queue, return it
+ * the caller owns the buffer and releases it once processed
  * 
  * @param buffer pointer used to return the buffer
+ * @param wait max time to wait for a buffer
  * @return true if buffer available
  * @return false no buffer available
  */
-bool uart_get_rx_buffer(uint8_t *buffer)
+bool uart_get_rx_buffer(PACKET_BUFFER **buffer, TickType_t wait)
 {
-  BaseType_t anymsg = xQueueReceive(rx_uart_queue, buffer, 0);
+  BaseType_t anymsg = xQueueReceive(rx_uart_queue, buffer, wait);
   if (pdTRUE == anymsg)
   {
     return true;
@@ -46,145 +126,732 @@ bool uart_get_rx_buffer(uint8_t *buffer)
 
 /**
  * @brief push a buffer to tx queue. 
- * Add byte stuffing prior to pushing it to the queue.
+ * Framing is added by the tx task, while writing to the UART.
+ * The buffer is handed over, released even if not pushed.
  * 
- * @param buffer buffer to push on the queue
- * @param length length of the buffer
+ * @param buffer buffer to push on the queue, length bytes of data to send
  * @return true success
  * @return false if buffer was not pushed
  */
-bool uart_put_tx_buffer(uint8_t *buffer, uint8_t length)
+bool uart_put_tx_buffer(PACKET_BUFFER *buffer)
 {
-  // if message is too long for tx drop it and return error
-  // max size is UART_TX_BUFFER_SIZE -2, since at least START and STOP bytes will be added
-  if ((UART_TX_BUFFER_SIZE -2) < length)
+  if (pdTRUE != xQueueSendToBack(tx_uart_queue, &buffer, 0))
   {
+    packet_pool_release(buffer);
     return false;
   }
-  uint8_t tx_buffer[UART_TX_BUFFER_SIZE];
-  uint8_t index = 1;
-  tx_buffer[index++] = UART_FLAG_START;
-  for (int i = 0; i < length; i++)
+#ifdef SINGLE_REACTOR
+  reactor_post(REACTOR_EVENT_UART_TX);
+#endif
+  return true;
+}
+
+/**
+ * @brief push a buffer to tx queue, and switch to new link settings once it is sent
+ * the buffers queued after it are sent with the new baud rate and framing
+ * 
+ * @param buffer buffer to push on the queue, handed over
+ * @param link link settings to switch to
+ * @return true success
+ * @return false if buffer was not pushed, link settings unchanged
+ */
+bool uart_put_tx_buffer_switch(PACKET_BUFFER *buffer, const UART_LINK_SETTINGS *link)
+{
+  uart_switch_link = *link;
+  uart_switch_buffer = buffer;
+  if (!uart_put_tx_buffer(buffer))
   {
-    if ((buffer[i] == UART_FLAG_START) || (buffer[i] == UART_FLAG_STOP) || (buffer[i] == UART_FLAG_ESC))
-    {
-      tx_buffer[index++] = UART_FLAG_ESC;
-    }
-    tx_buffer[index++] = buffer[i];
-    // return if index > UART_TX_BUFFER_SIZE
-    if (index > (UART_TX_BUFFER_SIZE -1))
+    uart_switch_buffer = NULL;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief check whether the host can switch to a baud rate
+ * 
+ * @param baud_rate baud rate
+ * @return true if supported
+ * @return false if not supported
+ */
+bool uart_is_valid_baud_rate(uint32_t baud_rate)
+{
+  for (uint8_t i = 0; i < sizeof(UART_BAUD_RATES) / sizeof(UART_BAUD_RATES[0]); i++)
+  {
+    if (UART_BAUD_RATES[i] == baud_rate)
     {
-      return false;
+      return true;
     }
   }
-  tx_buffer[index++] = UART_FLAG_STOP;
-  tx_buffer[0] = index;
-  xQueueSendToBack(tx_uart_queue, tx_buffer, 0);
-  return true;
+  return false;
 }
 
 /**
- * @brief FreeRTOS task
- * decode incoming message and push it to rx queue
+ * @brief drop the message being decoded, if any, and wait for the next message
+ * stuffing waits for the next START flag, COBS decodes the next bytes as a new message
  * 
- * @param pvParameters not used
  */
-void task_uart_rx(void *pvParameters)
+static void uart_decode_reset()
 {
+  if (NULL != rx_buffer)
+  {
+    packet_pool_release(rx_buffer);
+    rx_buffer = NULL;
+  }
+  digitalWrite(WHITE_LED, LOW);
+  rx_index = 0;
+  rx_esc_next_byte = false;
+  rx_state = (UART_FRAMING_COBS == rx_framing) ? RX_ACTIVE : RX_IDLE;
+}
 
-  uint8_t i = 0;
-  bool esc_next_byte = false;
-  UART_RX_STATE rx_state = RX_IDLE;
-  uint8_t rx_buffer[UART_RX_BUFFER_SIZE];
+/**
+ * @brief hand the message decoded over to the rx handler or push it to rx queue, get ready for next rx message
+ * 
+ */
+static void uart_decode_complete()
+{
+  rx_buffer->length = rx_index;
+  if (NULL != uart_rx_handler)
+  {
+    uart_rx_handler(rx_buffer);
+  }
+  else if (pdTRUE != xQueueSendToBack(rx_uart_queue, &rx_buffer, 0))
+  {
+    uart_rx_drop_counter++;
+    packet_pool_release(rx_buffer);
+  }
+  rx_buffer = NULL;
+  uart_decode_reset();
+}
 
-  while (1)
+/**
+ * @brief decode a chunk of byte stuffed bytes, push complete messages to rx queue
+ * runs of plain bytes are copied at once, up to the next ESC or STOP flag
+ * a message dropped is skipped up to its STOP flag, its escaped bytes never taken for the START of a message
+ * 
+ * @param chunk bytes received
+ * @param length number of bytes
+ */
+static void uart_decode_stuffing(const uint8_t *chunk, size_t length)
+{
+  size_t k = 0;
+  while (k < length)
   {
-    // a character has been received
-    if (Serial.available())
+    if (RX_IDLE == rx_state)
     {
-      uint8_t receivedByte = Serial.read(); // Read the received byte
-
-      switch (rx_state)
+      // skip up to the START flag
+      const uint8_t *start = (const uint8_t *)memchr(&chunk[k], UART_FLAG_START, length - k);
+      if (NULL == start)
       {
-      case RX_IDLE:
-        if (receivedByte == UART_FLAG_START)
+        return;
+      }
+      k = start - chunk + 1;
+      // decode straight into a packet buffer, dropped if the pool is exhausted
+      rx_buffer = packet_pool_alloc();
+      if (NULL != rx_buffer)
+      {
+        rx_state = RX_ACTIVE;
+        digitalWrite(WHITE_LED, HIGH);
+      }
+      else
+      {
+        uart_rx_drop_counter++;
+        rx_state = RX_DISCARD;
+      }
+      continue;
+    }
+    if (RX_DISCARD == rx_state)
+    {
+      // skip up to the STOP flag, an unescaped START flag begins the next message if the STOP flag was lost
+      for (; k < length; k++)
+      {
+        if (rx_esc_next_byte)
+        {
+          rx_esc_next_byte = false;
+        }
+        else if (chunk[k] == UART_FLAG_ESC)
         {
-          rx_state = RX_ACTIVE;
-          digitalWrite(WHITE_LED, HIGH);
+          rx_esc_next_byte = true;
         }
-        break;
-      case RX_ACTIVE:
-        rx_buffer[i++] = receivedByte;
-        // manage escaping
-        // if escaping, keep character and remove escape_next_byte
-        if (esc_next_byte == true)
+        else if (chunk[k] == UART_FLAG_START)
         {
-          esc_next_byte = false;
+          rx_state = RX_IDLE;
+          break;
         }
-        // if esc flag, ignore character and wait for next one
-        else if (receivedByte == UART_FLAG_ESC)
+        else if (chunk[k] == UART_FLAG_STOP)
         {
-          esc_next_byte = true;
-          i = i - 1;
+          rx_state = RX_IDLE;
+          k++;
+          break;
         }
-        // if stop flag, push message in ring buffer, get ready for next rx message
-        else if (receivedByte == UART_FLAG_STOP)
+      }
+      continue;
+    }
+    // if escaping, keep character whatever its value
+    size_t run = k;
+    if (rx_esc_next_byte)
+    {
+      rx_esc_next_byte = false;
+      run++;
+    }
+    while ((run < length) && (chunk[run] != UART_FLAG_ESC) && (chunk[run] != UART_FLAG_STOP))
+    {
+      run++;
+    }
+    if (rx_index + (run - k) > PACKET_POOL_BLOCK_SIZE)
+    {
+      // message too long, drop it
+      uart_rx_drop_counter++;
+      uart_decode_reset();
+      rx_state = RX_DISCARD;
+      k = run;
+      continue;
+    }
+    memcpy(&rx_buffer->data[rx_index], &chunk[k], run - k);
+    rx_index += run - k;
+    k = run;
+    if (k == length)
+    {
+      break;
+    }
+    // if esc flag, ignore character and wait for next one
+    if (chunk[k] == UART_FLAG_ESC)
+    {
+      rx_esc_next_byte = true;
+    }
+    // if stop flag, push message in rx queue, get ready for next rx message
+    else
+    {
+      uart_decode_complete();
+    }
+    k++;
+  }
+}
+
+/**
+ * @brief decode a chunk of COBS bytes, push complete messages to rx queue
+ * the bytes following the first code byte are copied at once up to the delimiter, and decoded in place:
+ * each code byte is replaced by the zero it stands for
+ * 
+ * @param chunk bytes received
+ * @param length number of bytes
+ */
+static void uart_decode_cobs(const uint8_t *chunk, size_t length)
+{
+  size_t k = 0;
+  while (k < length)
+  {
+    const uint8_t *delimiter = (const uint8_t *)memchr(&chunk[k], UART_COBS_DELIMITER, length - k);
+    size_t run = (NULL == delimiter) ? length : (delimiter - chunk);
+    if ((RX_ACTIVE == rx_state) && (run > k))
+    {
+      if (NULL == rx_buffer)
+      {
+        // decode straight into a packet buffer, dropped if the pool is exhausted
+        rx_buffer = packet_pool_alloc();
+        if (NULL == rx_buffer)
         {
-          // store message
-          xQueueSendToBack(rx_uart_queue, &rx_buffer[0], 0);
-          i = 0;
+          uart_rx_drop_counter++;
           rx_state = RX_IDLE;
-          // esc_next_byte = false;
-          digitalWrite(WHITE_LED, LOW);
+          k = run;
+          continue;
         }
-        break;
-      default:
-        break;
+        digitalWrite(WHITE_LED, HIGH);
+        rx_cobs_code = chunk[k++];
+      }
+      if (rx_index + (run - k) > PACKET_POOL_BLOCK_SIZE)
+      {
+        // message too long, drop it up to the delimiter
+        uart_rx_drop_counter++;
+        uart_decode_reset();
+        rx_state = RX_IDLE;
+        k = run;
+        continue;
+      }
+      memcpy(&rx_buffer->data[rx_index], &chunk[k], run - k);
+      rx_index += run - k;
+    }
+    k = run;
+    if (k == length)
+    {
+      break;
+    }
+    // delimiter, decode the message in place
+    if (NULL != rx_buffer)
+    {
+      uint16_t code = rx_cobs_code - 1;
+      while (code < rx_index)
+      {
+        uint8_t next = rx_buffer->data[code];
+        rx_buffer->data[code] = 0;
+        code += next;
       }
+      // the last block must end with the message
+      if (code == rx_index)
+      {
+        uart_decode_complete();
+      }
+    }
+    uart_decode_reset();
+    k++;
+  }
+}
+
+/**
+ * @brief decode a chunk of received bytes with the framing in use
+ * the message being decoded is dropped when the framing changes
+ * 
+ * @param chunk bytes received
+ * @param length number of bytes
+ */
+static void uart_decode(const uint8_t *chunk, size_t length)
+{
+  if (rx_framing != uart_framing)
+  {
+    rx_framing = uart_framing;
+    uart_decode_reset();
+  }
+  if (UART_FRAMING_COBS == rx_framing)
+  {
+    uart_decode_cobs(chunk, length);
+  }
+  else
+  {
+    uart_decode_stuffing(chunk, length);
+  }
+}
+
+/**
+ * @brief wait for a UART driver event, then decode all the bytes received so far
+ * 
+ * @param wait max time to wait for an event
+ * @return true if an event was processed
+ * @return false on timeout
+ */
+bool uart_rx_process(TickType_t wait)
+{
+  uart_event_t event;
+  uint8_t chunk[UART_RX_CHUNK_SIZE];
+
+  if (pdTRUE != xQueueReceive(uart_event_queue, &event, wait))
+  {
+    return false;
+  }
+  switch (event.type)
+  {
+  case UART_FIFO_OVF:
+  case UART_BUFFER_FULL:
+    // bytes were lost, the message being decoded is corrupted
+    uart_rx_drop_counter++;
+    uart_flush_input(UART_PORT);
+    uart_decode_reset();
+    return true;
+  case UART_PATTERN_DET:
+    // STOP flag positions are not used, the decoder finds the flags itself
+    uart_pattern_queue_reset(UART_PORT, UART_PATTERN_QUEUE_SIZE);
+    break;
+  default:
+    break;
+  }
+  size_t length = 0;
+  uart_get_buffered_data_len(UART_PORT, &length);
+  while (length > 0)
+  {
+    int n = uart_read_bytes(UART_PORT, chunk, (length < sizeof(chunk)) ? length : sizeof(chunk), 0);
+    if (n <= 0)
+    {
+      break;
+    }
+    uart_decode(chunk, n);
+    length -= n;
+  }
+  return true;
+}
+
+/**
+ * @brief FreeRTOS task
+ * decode incoming message and push it to rx queue
+ * block until the UART driver reports received bytes
+ * 
+ * @param pvParameters not used
+ */
+void task_uart_rx(void *pvParameters)
+{
+  while (1)
+  {
+    // timeout only to account the wake up as the other pipeline tasks
+    uart_rx_process(pdMS_TO_TICKS(PIPELINE_TASK_WAIT_TIMEOUT));
+    perf_stats_wakeup();
+  }
+}
+
+/**
+ * @brief apply link settings: baud rate, framing and the matching end of message pattern
+ * 
+ * @param link link settings
+ */
+static void uart_set_link(const UART_LINK_SETTINGS *link)
+{
+  uart_set_baudrate(UART_PORT, link->baud_rate);
+  uart_baud_rate = link->baud_rate;
+  uart_framing = link->framing;
+  uart_enable_pattern_det_baud_intr(UART_PORT, (UART_FRAMING_COBS == link->framing) ? UART_COBS_DELIMITER : UART_FLAG_STOP, 1, 9, 0, 0);
+  uart_pattern_queue_reset(UART_PORT, UART_PATTERN_QUEUE_SIZE);
+}
+
+/**
+ * @brief byte stuffing encoder
+ * 
+ * @param data message to encode
+ * @param length message length
+ * @param out encoded bytes, room for UART_ENCODED_MAX_SIZE(length) bytes
+ * @return size_t number of bytes encoded
+ */
+static size_t uart_encode_stuffing(const uint8_t *data, size_t length, uint8_t *out)
+{
+  size_t index = 0;
+  out[index++] = UART_FLAG_START;
+  for (size_t i = 0; i < length; i++)
+  {
+    if ((data[i] == UART_FLAG_START) || (data[i] == UART_FLAG_STOP) || (data[i] == UART_FLAG_ESC))
+    {
+      out[index++] = UART_FLAG_ESC;
+    }
+    out[index++] = data[i];
+  }
+  out[index++] = UART_FLAG_STOP;
+  return index;
+}
+
+/**
+ * @brief COBS encoder, single pass: the code of a block is written once its zero (or the message end) is reached
+ * 
+ * @param data message to encode
+ * @param length message length, shorter than 254 bytes
+ * @param out encoded bytes, room for length + 2 bytes
+ * @return size_t number of bytes encoded
+ */
+static size_t uart_encode_cobs(const uint8_t *data, size_t length, uint8_t *out)
+{
+  size_t code = 0;
+  size_t index = 1;
+  for (size_t i = 0; i < length; i++)
+  {
+    if (0 == data[i])
+    {
+      out[code] = index - code;
+      code = index++;
     }
     else
     {
-      vTaskDelay(10 / portTICK_PERIOD_MS);
+      out[index++] = data[i];
     }
+  }
+  out[code] = index - code;
+  out[index++] = UART_COBS_DELIMITER;
+  return index;
+}
 
+/**
+ * @brief tx burst, frames encoded back to back and written to the UART driver at once
+ * the buffers are released once written
+ * 
+ */
+static uint8_t uart_burst[UART_TX_BURST_SIZE];
+static size_t uart_burst_length = 0;
+static PACKET_BUFFER *uart_burst_buffers[UART_TX_BURST_FRAMES];
+static uint8_t uart_burst_count = 0;
+
+/**
+ * @brief write the burst to the UART driver, and release its buffers
+ * 
+ */
+static void uart_burst_flush()
+{
+  if (0 == uart_burst_count)
+  {
+    return;
+  }
+  uart_write_bytes(UART_PORT, uart_burst, uart_burst_length);
+  // the uplink latency runs until the last byte is out, estimated without waiting for it:
+  // the burst is sent after the bytes still queued in the driver, 10 bits per byte at the baud rate in use
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  if ((int32_t)(uart_tx_drain_ts - now) < 0)
+  {
+    uart_tx_drain_ts = now;
+  }
+  uart_tx_drain_ts += (uint32_t)(((uint64_t)uart_burst_length * 10 * 1000000) / uart_baud_rate);
+  for (uint8_t i = 0; i < uart_burst_count; i++)
+  {
+    PACKET_BUFFER *buffer = uart_burst_buffers[i];
+    if (0 != buffer->cycles)
+    {
+      perf_stats_uplink(buffer->copied, buffer->cycles, uart_tx_drain_ts - buffer->rx_ts);
+    }
+    packet_pool_release(buffer);
+  }
+  perf_stats_tx_burst(uart_burst_count);
+  uart_burst_length = 0;
+  uart_burst_count = 0;
+}
+
+/**
+ * @brief encode a buffer at the end of the burst with the framing in use
+ * the burst is written first if the buffer does not fit, and right after it if the link settings switch after this buffer
+ * 
+ * @param buffer buffer to send, handed over
+ */
+static void uart_burst_add(PACKET_BUFFER *buffer)
+{
+  if (((uart_burst_length + UART_ENCODED_MAX_SIZE(buffer->length)) > sizeof(uart_burst)) || (UART_TX_BURST_FRAMES == uart_burst_count))
+  {
+    uart_burst_flush();
+  }
+  uint32_t start = ESP.getCycleCount();
+  size_t length;
+  if (UART_FRAMING_COBS == uart_framing)
+  {
+    length = uart_encode_cobs(buffer->data, buffer->length, &uart_burst[uart_burst_length]);
+  }
+  else
+  {
+    length = uart_encode_stuffing(buffer->data, buffer->length, &uart_burst[uart_burst_length]);
+  }
+  uart_burst_length += length;
+  buffer->copied += length;
+  if (0 != buffer->cycles)
+  {
+    buffer->cycles += ESP.getCycleCount() - start;
+  }
+  uart_burst_buffers[uart_burst_count++] = buffer;
+  if (buffer == uart_switch_buffer)
+  {
+    // synchronized point, switch once the last byte is out
+    uart_burst_flush();
+    uart_switch_buffer = NULL;
+    uart_wait_tx_done(UART_PORT, portMAX_DELAY);
+    uart_set_link(&uart_switch_link);
+  }
+}
+
+/**
+ * @brief send a buffer and all the buffers queued in the tx queue in a burst
+ * with UART_TX_COALESCE_MS, buffers queued within the window after the first one join the burst
+ * 
+ * @param buffer first buffer of the burst, handed over
+ */
+static void uart_tx_burst(PACKET_BUFFER *buffer)
+{
+  TickType_t wait = 0;
+#if defined(UART_TX_COALESCE_MS) && !defined(SINGLE_REACTOR)
+  // the reactor never waits here, the window would delay the other stages
+  const TickType_t window = pdMS_TO_TICKS(UART_TX_COALESCE_MS);
+  TickType_t start = xTaskGetTickCount();
+#endif
+  do
+  {
+    uart_burst_add(buffer);
+#if defined(UART_TX_COALESCE_MS) && !defined(SINGLE_REACTOR)
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    wait = (elapsed < window) ? (window - elapsed) : 0;
+#endif
+  } while (pdTRUE == xQueueReceive(tx_uart_queue, &buffer, wait));
+  uart_burst_flush();
+}
+
+/**
+ * @brief send all buffers queued in the tx queue
+ * 
+ */
+void uart_tx_process()
+{
+  PACKET_BUFFER *buffer;
+  if (pdTRUE == xQueueReceive(tx_uart_queue, &buffer, 0))
+  {
+    uart_tx_burst(buffer);
   }
 }
 
 /**
  * @brief FreeRTOS task
- * check whether there is a buffer in the tx queue - send it to uart if any
+ * check whether there is a buffer in the tx queue - send it to uart with all the others queued if any
+ * block until a buffer is queued
  * 
  * @param pvParameters not used
  */
 void task_uart_tx(void *pvParameters)
 {
-  uint8_t tx_buffer[UART_TX_BUFFER_SIZE];
+  PACKET_BUFFER *buffer;
   while (1)
   {
-    BaseType_t anymsg = xQueueReceive(tx_uart_queue, tx_buffer, 0);
+    BaseType_t anymsg = xQueueReceive(tx_uart_queue, &buffer, pdMS_TO_TICKS(PIPELINE_TASK_WAIT_TIMEOUT));
+    perf_stats_wakeup();
     if (pdTRUE == anymsg)
     {
-      for (int i = 1; i < tx_buffer[0]; i++)
-      Serial.write(tx_buffer[i]);
+      uart_tx_burst(buffer);
     }
-    vTaskDelay(10 / portTICK_PERIOD_MS);
   }
 }
 
-
 /**
  * @brief initialize uart 
+ * install the UART driver with its event queue, end of message pattern detection to wake up the decoder
  * create rx and tx queue and initialized WHITE_LED as activity led
  * 
+ * @param link baud rate and framing
  */
-void uart_init(void)
+void uart_init(const UART_LINK_SETTINGS *link)
 {
-  Serial.begin(115200, SERIAL_8N1);
+  uart_config_t config = {};
+  config.baud_rate = link->baud_rate;
+  config.data_bits = UART_DATA_8_BITS;
+  config.parity = UART_PARITY_DISABLE;
+  config.stop_bits = UART_STOP_BITS_1;
+  config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
   pinMode(WHITE_LED, OUTPUT);
   digitalWrite(WHITE_LED, LOW);
-  while (!Serial)
-    ;
   // Create a queue to hold messages
-  rx_uart_queue = xQueueCreate(UART_RX_FIFO_ITEMS, UART_RX_BUFFER_SIZE * sizeof(uint8_t));
-  tx_uart_queue = xQueueCreate(UART_TX_FIFO_ITEMS, UART_TX_BUFFER_SIZE * sizeof(uint8_t));
+  rx_uart_queue = xQueueCreate(UART_RX_FIFO_ITEMS, sizeof(PACKET_BUFFER *));
+  tx_uart_queue = xQueueCreate(UART_TX_FIFO_ITEMS, sizeof(PACKET_BUFFER *));
+  uart_param_config(UART_PORT, &config);
+  uart_driver_install(UART_PORT, UART_RX_RING_SIZE, UART_TX_RING_SIZE, UART_EVENT_QUEUE_SIZE, &uart_event_queue, 0);
+#ifdef SINGLE_REACTOR
+  reactor_attach_uart(uart_event_queue);
+#endif
+  uart_set_link(link);
+  rx_framing = link->framing;
+  uart_decode_reset();
+}
+
+#ifdef UART_FRAMING_BENCHMARK
+/**
+ * @brief benchmark output, one encoded message
+ * 
+ */
+static uint8_t uart_benchmark_frame[UART_ENCODED_MAX_SIZE(PACKET_POOL_BLOCK_SIZE)];
+static size_t uart_benchmark_length = 0;
+
+/**
+ * @brief encode and decode a message with a framing, through the rx queue
+ * 
+ * @param framing framing
+ * @param data message
+ * @param length message length
+ * @param cycles used to return the cpu cycles to encode and decode
+ * @return true if the message decoded is identical
+ * @return false on mismatch
+ */
+static bool uart_benchmark_framing(UART_FRAMING framing, const uint8_t *data, size_t length, uint32_t *cycles)
+{
+  PACKET_BUFFER *buffer = NULL;
+  uint32_t start = ESP.getCycleCount();
+  if (UART_FRAMING_COBS == framing)
+  {
+    uart_benchmark_length = uart_encode_cobs(data, length, uart_benchmark_frame);
+    uart_decode_cobs(uart_benchmark_frame, uart_benchmark_length);
+  }
+  else
+  {
+    uart_benchmark_length = uart_encode_stuffing(data, length, uart_benchmark_frame);
+    uart_decode_stuffing(uart_benchmark_frame, uart_benchmark_length);
+  }
+  *cycles = ESP.getCycleCount() - start;
+  if (pdTRUE != xQueueReceive(rx_uart_queue, &buffer, 0))
+  {
+    return false;
+  }
+  bool match = (buffer->length == length) && (0 == memcmp(buffer->data, data, length));
+  packet_pool_release(buffer);
+  return match;
+}
+
+/**
+ * @brief run both framings on a max sized (139 bytes) random message, and a worst case message made of flag bytes only
+ * report overhead bytes and encode plus decode cycles per byte, check the message decoded is identical
+ * to run before the UART rx task starts
+ *
+ */
+void uart_framing_benchmark(void)
+{
+  // decoded messages are checked from the rx queue
+  UART_RX_HANDLER handler = uart_rx_handler;
+  uart_rx_handler = NULL;
+  const char *names[] = {"stuffing", "cobs"};
+  const char *payloads[] = {"random", "worst case"};
+  const uint16_t iterations = 1000;
+  uint8_t data[2][139];
+  char log[128];
+
+  for (unsigned int i = 0; i < sizeof(data[0]); i++)
+  {
+    data[0][i] = (uint8_t)esp_random();
+    data[1][i] = UART_FLAG_START + (i % 3);
+  }
+  for (unsigned int p = 0; p < 2; p++)
+  {
+    for (unsigned int f = 0; f < UART_FRAMING_COUNT; f++)
+    {
+      uint64_t total = 0;
+      uint32_t cycles;
+      bool match = true;
+      rx_framing = (UART_FRAMING)f;
+      uart_decode_reset();
+      for (uint16_t i = 0; i < iterations; i++)
+      {
+        match &= uart_benchmark_framing((UART_FRAMING)f, data[p], sizeof(data[p]), &cycles);
+        total += cycles;
+      }
+      uint32_t cpb = (uint32_t)((total * 100) / ((uint32_t)iterations * sizeof(data[p])));
+      snprintf(log, sizeof(log), "framing %s %s %u bytes: +%u bytes, %lu.%02lu cycles/byte%s", names[f], payloads[p], (unsigned int)sizeof(data[p]),
+               (unsigned int)(uart_benchmark_length - sizeof(data[p])), (unsigned long)(cpb / 100), (unsigned long)(cpb % 100), match ? "" : " MISMATCH");
+      serial_api_send_log_message(log);
+    }
+  }
+  uart_rx_handler = handler;
+  rx_framing = uart_framing;
+  uart_decode_reset();
+}
+#endif
+
+#ifdef UART_TX_BENCHMARK
+/**
+ * @brief send 1000 uplink sized null messages (SERIAL_MSG_TYPE_NULL, ignored by the host) as fast as possible
+ * report the sustained frames per second at the baud rate and framing in use
+ * to run before the UART tx task starts
+ *
+ */
+void uart_tx_benchmark(void)
+{
+  const uint16_t frames = 1000;
+  const uint8_t length = 48;
+  uint16_t sent = 0;
+  uint32_t baud_rate = 0;
+  char log[128];
+
+  int64_t start = esp_timer_get_time();
+  while (sent < frames)
+  {
+    PACKET_BUFFER *buffer = NULL;
+    if (0 != uxQueueSpacesAvailable(tx_uart_queue))
+    {
+      buffer = packet_pool_alloc();
+    }
+    if (NULL == buffer)
+    {
+      uart_tx_process();
+      continue;
+    }
+    memset(buffer->data, 0, length);
+    buffer->length = length;
+    uart_put_tx_buffer(buffer);
+    sent++;
+  }
+  uart_tx_process();
+  uart_wait_tx_done(UART_PORT, portMAX_DELAY);
+  uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+  uart_get_baudrate(UART_PORT, &baud_rate);
+  snprintf(log, sizeof(log), "uart tx %u frames of %u bytes at %lu baud: %lu frames/s", frames, length, (unsigned long)baud_rate,
+           (unsigned long)(((uint64_t)frames * 1000000) / elapsed_us));
+  serial_api_send_log_message(log);
 }
+#endif
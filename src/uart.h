@@ -8,21 +8,58 @@
 #ifndef UART_H
 #define UART_H
 
+#include "packet_pool.h"
+
+/**
+ * @def UART_BAUD_RATE
+ * @brief The default UART baud rate, until another one is negotiated with the host.
+ */
+#define UART_BAUD_RATE 115200
+/**
+ * @def UART_RX_RING_SIZE
+ * @brief The size of the UART driver receive ring buffer, filled from the hardware FIFO by the driver interrupt.
+ */
+#define UART_RX_RING_SIZE 4096
 /**
- * @def UART_RX_BUFFER_SIZE
- * @brief The size of the UART receive buffer.
+ * @def UART_TX_RING_SIZE
+ * @brief The size of the UART driver transmit ring buffer.
  */
-#define UART_RX_BUFFER_SIZE 256
+#define UART_TX_RING_SIZE 1024
+/**
+ * @def UART_EVENT_QUEUE_SIZE
+ * @brief The number of items in the UART driver event queue.
+ */
+#define UART_EVENT_QUEUE_SIZE 20
+/**
+ * @def UART_PATTERN_QUEUE_SIZE
+ * @brief The number of pattern positions recorded by the UART driver.
+ */
+#define UART_PATTERN_QUEUE_SIZE 8
+/**
+ * @def UART_RX_CHUNK_SIZE
+ * @brief The size of the chunks read from the receive ring buffer and fed to the decoder.
+ */
+#define UART_RX_CHUNK_SIZE 128
 /**
  * @def UART_RX_FIFO_ITEMS
  * @brief The number of items in the UART receive FIFO.
  */
 #define UART_RX_FIFO_ITEMS 8
 /**
- * @def UART_TX_BUFFER_SIZE
- * @brief The size of the UART transmit buffer.
+ * @def UART_TX_BURST_SIZE
+ * @brief The size of the UART transmit burst, frames encoded back to back and written to the UART driver at once.
+ */
+#define UART_TX_BURST_SIZE 1024
+/**
+ * @def UART_TX_BURST_FRAMES
+ * @brief The max number of frames in a UART transmit burst.
+ */
+#define UART_TX_BURST_FRAMES 16
+/**
+ * @def UART_ENCODED_MAX_SIZE
+ * @brief The max size of a message once encoded, byte stuffing worst case: every byte escaped, START and STOP flags.
  */
-#define UART_TX_BUFFER_SIZE  256
+#define UART_ENCODED_MAX_SIZE(length) (2 * (length) + 2)
 /**
  * @def UART_TX_FIFO_ITEMS
  * @brief The number of items in the UART transmit FIFO.
@@ -51,20 +88,77 @@ static const uint8_t UART_FLAG_STOP   = 0x13;
 static const uint8_t UART_FLAG_ESC    = 0x14;
 
 /**
- * @brief UART RX State (actually simply 2) to well manage bytes stuffing decoding
+ * @brief UART RX State to well manage bytes stuffing decoding
+ * byte stuffing: IDLE waiting for the START flag, ACTIVE decoding a message, DISCARD skipping a message dropped up to its STOP flag
+ * COBS framing: IDLE discarding bytes up to the next delimiter, ACTIVE decoding a message
  * 
  */
 typedef enum
 {
   RX_IDLE,
   RX_ACTIVE,
+  RX_DISCARD,
 } UART_RX_STATE;
 
+/**
+ * @brief UART framing modes
+ * STUFFING START/STOP flags with ESC byte stuffing, data dependent overhead (up to x2)
+ * COBS Consistent Overhead Byte Stuffing, 0x00 delimiter, constant overhead of 2 bytes per message
+ * 
+ */
+typedef enum
+{
+  UART_FRAMING_STUFFING = 0,
+  UART_FRAMING_COBS = 1,
+  UART_FRAMING_COUNT
+} UART_FRAMING;
+
+/**
+ * @brief UART link settings negotiated with the host
+ * 
+ * @return typedef struct 
+ */
+typedef struct
+{
+  uint32_t baud_rate;
+  UART_FRAMING framing;
+} UART_LINK_SETTINGS;
+
+/**
+ * @brief COBS message delimiter
+ * 
+ */
+static const uint8_t UART_COBS_DELIMITER = 0x00;
 
-void uart_init();
-bool uart_get_rx_buffer(uint8_t *buffer);
-bool uart_put_tx_buffer(uint8_t *buffer, uint8_t length);
+// uncomment to run the framing benchmark at boot and report the results as log messages
+// #define UART_FRAMING_BENCHMARK
+// uncomment to measure the sustained frames per second sent to the host at boot, reported as a log message
+// #define UART_TX_BENCHMARK
+
+
+extern uint32_t uart_rx_drop_counter;
+
+/**
+ * @brief handler of the messages received, called by the rx stage, takes the buffer over
+ * 
+ */
+typedef void (*UART_RX_HANDLER)(PACKET_BUFFER *buffer);
+
+void uart_init(const UART_LINK_SETTINGS *link);
+bool uart_is_valid_baud_rate(uint32_t baud_rate);
+void uart_set_rx_handler(UART_RX_HANDLER handler);
+bool uart_get_rx_buffer(PACKET_BUFFER **buffer, TickType_t wait);
+bool uart_put_tx_buffer(PACKET_BUFFER *buffer);
+bool uart_put_tx_buffer_switch(PACKET_BUFFER *buffer, const UART_LINK_SETTINGS *link);
+bool uart_rx_process(TickType_t wait);
+void uart_tx_process();
 void task_uart_rx(void *pvParameters);
 void task_uart_tx(void *pvParameters);
+#ifdef UART_FRAMING_BENCHMARK
+void uart_framing_benchmark(void);
+#endif
+#ifdef UART_TX_BENCHMARK
+void uart_tx_benchmark(void);
+#endif
 
 #endif
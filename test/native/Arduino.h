@@ -0,0 +1,59 @@
+/**
+ * @file Arduino.h
+ * @author mchacher
+ * @brief host stand-in of the Arduino core, for the native unit tests
+ * time is simulated: it only moves when a test advances native_time_us (or calls delay)
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define IRAM_ATTR
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x02
+#define RISING 0x01
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline unsigned long millis() { return (unsigned long)(native_time_us / 1000); }
+inline unsigned long micros() { return (unsigned long)native_time_us; }
+inline void delay(unsigned long ms) { native_time_us += (uint64_t)ms * 1000; }
+inline void yield() {}
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+inline void digitalWrite(uint8_t pin, uint8_t val) {}
+
+/**
+ * @brief ESP object, the cycle counter moves on at each read
+ *
+ */
+class EspClass
+{
+public:
+  uint32_t getCycleCount() { return cycles += 100; }
+  uint32_t getFreeHeap() { return 200000; }
+  uint32_t getMinFreeHeap() { return 150000; }
+  uint32_t cycles = 0;
+};
+
+inline EspClass ESP;
+
+#endif
@@ -0,0 +1,202 @@
+/**
+ * @file LoRa.h
+ * @author mchacher
+ * @brief host stand-in of the LoRa transceiver library, for the native unit tests
+ * models the operating mode, the IRQ flags and the FIFO of the transceiver
+ * the test plays the radio side: a frame received, TxDone or CadDone sets the IRQ flag and raises DIO0,
+ * which calls the onDio0 callback as the interrupt would
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef NATIVE_LORA_H
+#define NATIVE_LORA_H
+
+#include <Arduino.h>
+#include <vector>
+
+#define PA_OUTPUT_RFO_PIN 0
+#define PA_OUTPUT_PA_BOOST_PIN 1
+
+// IRQ flags, as in REG_IRQ_FLAGS
+#define NATIVE_LORA_IRQ_RX_DONE 0x40
+#define NATIVE_LORA_IRQ_TX_DONE 0x08
+#define NATIVE_LORA_IRQ_CAD_DONE 0x04
+#define NATIVE_LORA_IRQ_CAD_DETECTED 0x01
+
+/**
+ * @brief transceiver operating modes
+ *
+ */
+typedef enum
+{
+  NATIVE_LORA_STDBY,
+  NATIVE_LORA_RX,
+  NATIVE_LORA_CAD,
+  NATIVE_LORA_TX
+} NATIVE_LORA_MODE;
+
+class LoRaClass
+{
+public:
+  int begin(long frequency)
+  {
+    this->frequency = frequency;
+    mode = NATIVE_LORA_STDBY;
+    return 1;
+  }
+  void setPins(int ss, int reset, int dio0) {}
+  void setSpreadingFactor(int sf) { spreading_factor = sf; }
+  void setSignalBandwidth(long sbw) { bandwidth = sbw; }
+  void setCodingRate4(int denominator) { coding_rate = denominator; }
+  void setSyncWord(int sw) { sync_word = sw; }
+  void setFrequency(long frequency) { this->frequency = frequency; }
+  void enableCrc() {}
+  void enableInvertIQ() { invert_iq = true; }
+  void disableInvertIQ() { invert_iq = false; }
+  void onDio0(void (*callback)(void)) { on_dio0 = callback; }
+  void idle() { mode = NATIVE_LORA_STDBY; }
+  void receive(int size = 0) { mode = NATIVE_LORA_RX; }
+  void channelActivityDetection() { mode = NATIVE_LORA_CAD; }
+  bool isReceiving() { return receiving; }
+
+  int reconfigure(long frequency, int sf, long sbw, int denominator)
+  {
+    idle();
+    setFrequency(frequency);
+    setSpreadingFactor(sf);
+    setSignalBandwidth(sbw);
+    setCodingRate4(denominator);
+    register_writes += 4;
+    return 4;
+  }
+  uint32_t registerWrites() { return register_writes; }
+
+  int beginPacket()
+  {
+    mode = NATIVE_LORA_STDBY;
+    fifo.clear();
+    return 1;
+  }
+  size_t writeFifo(const uint8_t *buffer, size_t size)
+  {
+    fifo.assign(buffer, buffer + size);
+    return size;
+  }
+  int endPacket(bool async = false)
+  {
+    sent.push_back(fifo);
+    mode = NATIVE_LORA_TX;
+    return 1;
+  }
+
+  bool txDone()
+  {
+    irq_reads++;
+    if (0 == (irq_flags & NATIVE_LORA_IRQ_TX_DONE))
+    {
+      return false;
+    }
+    irq_flags &= ~NATIVE_LORA_IRQ_TX_DONE;
+    return true;
+  }
+  int cadResult()
+  {
+    irq_reads++;
+    if (0 == (irq_flags & NATIVE_LORA_IRQ_CAD_DONE))
+    {
+      return -1;
+    }
+    int detected = (irq_flags & NATIVE_LORA_IRQ_CAD_DETECTED) ? 1 : 0;
+    irq_flags &= ~(NATIVE_LORA_IRQ_CAD_DONE | NATIVE_LORA_IRQ_CAD_DETECTED);
+    return detected;
+  }
+  int availablePacket()
+  {
+    irq_reads++;
+    int length = (irq_flags & NATIVE_LORA_IRQ_RX_DONE) ? (int)fifo.size() : 0;
+    irq_flags &= ~NATIVE_LORA_IRQ_RX_DONE;
+    return length;
+  }
+  size_t readFifo(uint8_t *buffer, size_t size)
+  {
+    if (size > fifo.size())
+    {
+      size = fifo.size();
+    }
+    memcpy(buffer, fifo.data(), size);
+    fifo_reads++;
+    return size;
+  }
+  int packetRssi() { return -60; }
+  float packetSnr() { return 7.5; }
+
+  /**
+   * @brief radio side: a frame is received, RxDone raises DIO0
+   *
+   * @param frame frame received
+   * @param size frame size
+   */
+  void nativeReceive(const uint8_t *frame, size_t size)
+  {
+    fifo.assign(frame, frame + size);
+    nativeIrq(NATIVE_LORA_IRQ_RX_DONE);
+  }
+
+  /**
+   * @brief radio side: the transmission is over, TxDone raises DIO0
+   *
+   */
+  void nativeTxDone()
+  {
+    mode = NATIVE_LORA_STDBY;
+    nativeIrq(NATIVE_LORA_IRQ_TX_DONE);
+  }
+
+  /**
+   * @brief radio side: the channel activity detection is over, CadDone raises DIO0
+   *
+   * @param detected true if LoRa activity was detected
+   */
+  void nativeCadDone(bool detected)
+  {
+    mode = NATIVE_LORA_STDBY;
+    nativeIrq(NATIVE_LORA_IRQ_CAD_DONE | (detected ? NATIVE_LORA_IRQ_CAD_DETECTED : 0));
+  }
+
+  /**
+   * @brief set IRQ flags, and raise DIO0 if the interrupt is attached
+   *
+   * @param flags IRQ flags
+   */
+  void nativeIrq(uint8_t flags)
+  {
+    irq_flags |= flags;
+    if (NULL != on_dio0)
+    {
+      on_dio0();
+    }
+  }
+
+  NATIVE_LORA_MODE mode = NATIVE_LORA_STDBY;
+  long frequency = 0;
+  int spreading_factor = 0;
+  long bandwidth = 0;
+  int coding_rate = 0;
+  int sync_word = 0;
+  bool invert_iq = false;
+  bool receiving = false;
+  uint8_t irq_flags = 0;
+  // IRQ flags reads and FIFO reads of the code under test
+  uint32_t irq_reads = 0;
+  uint32_t fifo_reads = 0;
+  uint32_t register_writes = 0;
+  std::vector<uint8_t> fifo;
+  // frames transmitted
+  std::vector<std::vector<uint8_t>> sent;
+  void (*on_dio0)(void) = NULL;
+};
+
+inline LoRaClass LoRa;
+
+#endif
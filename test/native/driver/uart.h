@@ -0,0 +1,172 @@
+/**
+ * @file uart.h
+ * @author mchacher
+ * @brief host stand-in of the ESP-IDF UART driver, for the native unit tests
+ * the bytes written are captured in native_uart_tx, the bytes to receive are fed in native_uart_rx
+ * the transmission is over (uart_wait_tx_done) once the test sets native_uart_tx_idle
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef NATIVE_DRIVER_UART_H
+#define NATIVE_DRIVER_UART_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+
+typedef int esp_err_t;
+typedef int uart_port_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_TIMEOUT 0x107
+#define UART_NUM_0 0
+#define UART_PIN_NO_CHANGE (-1)
+
+typedef enum
+{
+  UART_DATA,
+  UART_BREAK,
+  UART_BUFFER_FULL,
+  UART_FIFO_OVF,
+  UART_FRAME_ERR,
+  UART_PARITY_ERR,
+  UART_DATA_BREAK,
+  UART_PATTERN_DET,
+  UART_EVENT_MAX
+} uart_event_type_t;
+
+typedef struct
+{
+  uart_event_type_t type;
+  size_t size;
+  bool timeout_flag;
+} uart_event_t;
+
+typedef enum
+{
+  UART_DATA_5_BITS,
+  UART_DATA_6_BITS,
+  UART_DATA_7_BITS,
+  UART_DATA_8_BITS
+} uart_word_length_t;
+typedef enum
+{
+  UART_PARITY_DISABLE
+} uart_parity_t;
+typedef enum
+{
+  UART_STOP_BITS_1 = 1
+} uart_stop_bits_t;
+typedef enum
+{
+  UART_HW_FLOWCTRL_DISABLE
+} uart_hw_flowcontrol_t;
+
+typedef struct
+{
+  int baud_rate;
+  uart_word_length_t data_bits;
+  uart_parity_t parity;
+  uart_stop_bits_t stop_bits;
+  uart_hw_flowcontrol_t flow_ctrl;
+  uint8_t rx_flow_ctrl_thresh;
+} uart_config_t;
+
+// bytes written to the UART, and the size of each write
+inline std::vector<uint8_t> native_uart_tx;
+inline std::vector<size_t> native_uart_writes;
+// bytes received, not read yet
+inline std::deque<uint8_t> native_uart_rx;
+inline uint32_t native_uart_baud_rate = 0;
+// bytes written when the baud rate was last set
+inline size_t native_uart_baud_rate_offset = 0;
+// false while the bytes written are still being sent
+inline bool native_uart_tx_idle = true;
+// calls to uart_wait_tx_done, and those that would block the caller
+inline uint32_t native_uart_wait_counter = 0;
+inline uint32_t native_uart_blocking_wait_counter = 0;
+
+inline esp_err_t uart_driver_install(uart_port_t port, int rx_size, int tx_size, int queue_size, QueueHandle_t *queue, int flags)
+{
+  if (NULL != queue)
+  {
+    *queue = xQueueCreate(queue_size, sizeof(uart_event_t));
+  }
+  return ESP_OK;
+}
+
+inline esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+  native_uart_baud_rate = config->baud_rate;
+  return ESP_OK;
+}
+
+inline esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baud_rate)
+{
+  native_uart_baud_rate = baud_rate;
+  native_uart_baud_rate_offset = native_uart_tx.size();
+  return ESP_OK;
+}
+
+inline esp_err_t uart_get_baudrate(uart_port_t port, uint32_t *baud_rate)
+{
+  *baud_rate = native_uart_baud_rate;
+  return ESP_OK;
+}
+
+inline esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t port, char pattern, uint8_t count, int gap, int pre, int post) { return ESP_OK; }
+inline esp_err_t uart_pattern_queue_reset(uart_port_t port, int queue_length) { return ESP_OK; }
+
+inline int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+  native_uart_tx.insert(native_uart_tx.end(), (const uint8_t *)src, (const uint8_t *)src + size);
+  native_uart_writes.push_back(size);
+  native_uart_tx_idle = false;
+  return (int)size;
+}
+
+inline esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t wait)
+{
+  native_uart_wait_counter++;
+  if (native_uart_tx_idle)
+  {
+    return ESP_OK;
+  }
+  if (0 != wait)
+  {
+    // the caller would block until the bytes are out
+    native_uart_blocking_wait_counter++;
+    native_uart_tx_idle = true;
+    return ESP_OK;
+  }
+  return ESP_ERR_TIMEOUT;
+}
+
+inline esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size)
+{
+  *size = native_uart_rx.size();
+  return ESP_OK;
+}
+
+inline int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t wait)
+{
+  uint32_t n = 0;
+  while ((n < length) && !native_uart_rx.empty())
+  {
+    ((uint8_t *)buf)[n++] = native_uart_rx.front();
+    native_uart_rx.pop_front();
+  }
+  return (int)n;
+}
+
+inline esp_err_t uart_flush_input(uart_port_t port)
+{
+  native_uart_rx.clear();
+  return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * @file esp_system.h
+ * @author mchacher
+ * @brief host stand-in of the ESP-IDF system API, esp_random is a seeded generator for reproducible tests
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef NATIVE_ESP_SYSTEM_H
+#define NATIVE_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+inline uint32_t native_random_state = 1;
+
+inline uint32_t esp_random()
+{
+  // xorshift32
+  native_random_state ^= native_random_state << 13;
+  native_random_state ^= native_random_state >> 17;
+  native_random_state ^= native_random_state << 5;
+  return native_random_state;
+}
+
+inline void esp_restart() { abort(); }
+inline uint32_t esp_get_free_heap_size() { return 200000; }
+
+#endif
@@ -0,0 +1,12 @@
+/**
+ * @file esp_task_wdt.h
+ * @author mchacher
+ * @brief host stand-in of the ESP-IDF task watchdog, no watchdog on the host
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef NATIVE_ESP_TASK_WDT_H
+#define NATIVE_ESP_TASK_WDT_H
+
+#endif
@@ -0,0 +1,16 @@
+/**
+ * @file esp_timer.h
+ * @author mchacher
+ * @brief host stand-in of the ESP-IDF high resolution timer, on the simulated time
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef NATIVE_ESP_TIMER_H
+#define NATIVE_ESP_TIMER_H
+
+#include "freertos/FreeRTOS.h"
+
+inline int64_t esp_timer_get_time() { return (int64_t)native_time_us; }
+
+#endif
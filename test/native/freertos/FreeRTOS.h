@@ -0,0 +1,180 @@
+/**
+ * @file FreeRTOS.h
+ * @author mchacher
+ * @brief host stand-in of FreeRTOS, for the native unit tests
+ * single threaded: queues never block, tasks are not run, task notifications are counted for the test to take them
+ * ticks are milliseconds of the simulated time
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef NATIVE_FREERTOS_H
+#define NATIVE_FREERTOS_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+
+// simulated time since boot
+inline uint64_t native_time_us = 0;
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE ((BaseType_t)1)
+#define pdFALSE ((BaseType_t)0)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+#define configASSERT(x) assert(x)
+
+typedef struct
+{
+  uint32_t owner;
+  uint32_t count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+#define portENTER_CRITICAL(mux) ((mux)->count++)
+#define portEXIT_CRITICAL(mux) ((mux)->count--)
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(...)
+
+/**
+ * @brief queue, items copied in and out as in FreeRTOS
+ *
+ */
+struct QueueDefinition
+{
+  UBaseType_t length;
+  UBaseType_t item_size;
+  std::deque<std::vector<uint8_t>> items;
+};
+typedef QueueDefinition *QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+  return new QueueDefinition{length, item_size, {}};
+}
+
+inline BaseType_t native_queue_send(QueueHandle_t queue, const void *item, bool front)
+{
+  if (queue->items.size() >= queue->length)
+  {
+    return pdFALSE;
+  }
+  std::vector<uint8_t> copy((const uint8_t *)item, (const uint8_t *)item + queue->item_size);
+  if (front)
+  {
+    queue->items.push_front(copy);
+  }
+  else
+  {
+    queue->items.push_back(copy);
+  }
+  return pdTRUE;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait) { return native_queue_send(queue, item, false); }
+inline BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t wait) { return native_queue_send(queue, item, false); }
+inline BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t wait) { return native_queue_send(queue, item, true); }
+inline BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *woken) { return native_queue_send(queue, item, false); }
+
+inline BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t wait)
+{
+  if (queue->items.empty())
+  {
+    return pdFALSE;
+  }
+  memcpy(item, queue->items.front().data(), queue->item_size);
+  return pdTRUE;
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+  if (pdTRUE != xQueuePeek(queue, item, wait))
+  {
+    return pdFALSE;
+  }
+  queue->items.pop_front();
+  return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue->items.size(); }
+inline UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) { return queue->length - queue->items.size(); }
+
+inline BaseType_t xQueueReset(QueueHandle_t queue)
+{
+  queue->items.clear();
+  return pdPASS;
+}
+
+/**
+ * @brief task, never run: its notification value is given by the code under test and taken by the test
+ *
+ */
+struct tskTaskControlBlock
+{
+  uint32_t notification;
+  bool suspended;
+};
+typedef tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+// task the test is running as, the one ulTaskNotifyTake takes the notifications of
+inline TaskHandle_t native_current_task = NULL;
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack, void *parameters,
+                                          UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+  TaskHandle_t task = new tskTaskControlBlock{0, false};
+  if (NULL != handle)
+  {
+    *handle = task;
+  }
+  return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack, void *parameters, UBaseType_t priority, TaskHandle_t *handle)
+{
+  return xTaskCreatePinnedToCore(function, name, stack, parameters, priority, handle, 0);
+}
+
+inline void vTaskDelay(TickType_t ticks) { native_time_us += (uint64_t)ticks * 1000; }
+inline TickType_t xTaskGetTickCount() { return (TickType_t)(native_time_us / 1000); }
+inline void vTaskSuspend(TaskHandle_t task) { task->suspended = true; }
+inline void vTaskResume(TaskHandle_t task) { task->suspended = false; }
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return native_current_task; }
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  task->notification++;
+  return pdPASS;
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+  task->notification++;
+  if (NULL != woken)
+  {
+    *woken = pdTRUE;
+  }
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+  uint32_t value = native_current_task->notification;
+  if (0 != value)
+  {
+    native_current_task->notification = (pdTRUE == clear) ? 0 : value - 1;
+  }
+  return value;
+}
+
+#endif
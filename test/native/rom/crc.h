@@ -0,0 +1,29 @@
+/**
+ * @file crc.h
+ * @author mchacher
+ * @brief host equivalent of the ESP32 ROM CRC16 routine, to check the ROM backend wrapping on the host
+ * as the ROM crc16_be: poly 0x1021, msb first, initial and final values inverted
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#ifndef NATIVE_ROM_CRC_H
+#define NATIVE_ROM_CRC_H
+
+#include <stdint.h>
+
+inline uint16_t crc16_be(uint16_t crc, uint8_t const *buf, uint32_t len)
+{
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; i++)
+  {
+    crc ^= (uint16_t)buf[i] << 8;
+    for (uint8_t j = 0; j < 8; j++)
+    {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+  return ~crc;
+}
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * @file test_main.cpp
+ * @author mchacher
+ * @brief native unit tests of the CRC16 backends, and their host benchmark
+ * every backend must give the results of the bitwise reference implementation, whatever the length and alignment
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <unity.h>
+#include <chrono>
+// the ROM backend is built against the host equivalent of the ROM routine, test/native/rom/crc.h
+#define ARDUINO_ARCH_ESP32
+// module under test
+#include "crc16.cpp"
+#include <esp_system.h>
+#include "lora_home_packet.h"
+
+/**
+ * @brief backends checked against the reference implementation
+ *
+ */
+static const char *names[] = {"bitwise", "table", "slice4", "rom"};
+static uint16_t (*backends[])(const uint8_t *, unsigned int) = {
+    crc16_ccitt_bitwise,
+    crc16_ccitt_table,
+    crc16_ccitt_slice4,
+    crc16_ccitt_rom,
+};
+#define BACKEND_COUNT (sizeof(backends) / sizeof(backends[0]))
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE check value, and 0 for an empty buffer
+ *
+ */
+void test_check_value(void)
+{
+  const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  for (unsigned int b = 0; b < BACKEND_COUNT; b++)
+  {
+    TEST_ASSERT_EQUAL_HEX16_MESSAGE(0x29B1, backends[b](check, sizeof(check)), names[b]);
+    TEST_ASSERT_EQUAL_HEX16_MESSAGE(0x0000, backends[b](check, 0), names[b]);
+  }
+  TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16_ccitt(check, sizeof(check)));
+}
+
+/**
+ * @brief random data, random lengths up to twice the largest frame, at every alignment
+ *
+ */
+void test_backends_match_bitwise(void)
+{
+  uint8_t buffer[2 * LH_FRAME_MAX_SIZE + 8];
+  for (unsigned int i = 0; i < sizeof(buffer); i++)
+  {
+    buffer[i] = (uint8_t)esp_random();
+  }
+  for (unsigned int i = 0; i < 5000; i++)
+  {
+    unsigned int offset = i % 8;
+    unsigned int length = esp_random() % (2 * LH_FRAME_MAX_SIZE + 1);
+    buffer[offset + (esp_random() % (length + 1))] ^= (uint8_t)esp_random();
+    uint16_t reference = crc16_ccitt_bitwise(&buffer[offset], length);
+    for (unsigned int b = 1; b < BACKEND_COUNT; b++)
+    {
+      TEST_ASSERT_EQUAL_HEX16_MESSAGE(reference, backends[b](&buffer[offset], length), names[b]);
+    }
+    TEST_ASSERT_EQUAL_HEX16(reference, crc16_ccitt(&buffer[offset], length));
+  }
+}
+
+/**
+ * @brief every length from 0 to the largest frame, slice4 tail handling included
+ *
+ */
+void test_backends_match_bitwise_all_lengths(void)
+{
+  uint8_t buffer[LH_FRAME_MAX_SIZE];
+  for (unsigned int i = 0; i < sizeof(buffer); i++)
+  {
+    buffer[i] = (uint8_t)esp_random();
+  }
+  for (unsigned int length = 0; length <= sizeof(buffer); length++)
+  {
+    uint16_t reference = crc16_ccitt_bitwise(buffer, length);
+    for (unsigned int b = 1; b < BACKEND_COUNT; b++)
+    {
+      TEST_ASSERT_EQUAL_HEX16_MESSAGE(reference, backends[b](buffer, length), names[b]);
+    }
+  }
+}
+
+/**
+ * @brief host benchmark, on an ACK sized (11 bytes) and a max sized frame, as crc16_benchmark on the dongle
+ * reports nanoseconds per byte, the ranking of the backends on the host only hints at the one on the ESP32
+ *
+ */
+void test_benchmark(void)
+{
+  const unsigned int sizes[] = {11, LH_FRAME_MAX_SIZE};
+  const unsigned int iterations = 20000;
+  uint8_t data[LH_FRAME_MAX_SIZE];
+  char log[128];
+
+  for (unsigned int i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (uint8_t)esp_random();
+  }
+  for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    for (unsigned int b = 0; b < BACKEND_COUNT; b++)
+    {
+      volatile uint16_t result = 0;
+      auto start = std::chrono::steady_clock::now();
+      for (unsigned int i = 0; i < iterations; i++)
+      {
+        // the data changes at each iteration, not to be optimized out
+        data[0] = (uint8_t)i;
+        result = backends[b](data, sizes[s]);
+      }
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+      data[0] = (uint8_t)(iterations - 1);
+      uint16_t reference = crc16_ccitt_bitwise(data, sizes[s]);
+      snprintf(log, sizeof(log), "crc16 %s %u bytes: %.2f ns/byte", names[b], sizes[s], (double)elapsed / ((double)iterations * sizes[s]));
+      TEST_MESSAGE(log);
+      TEST_ASSERT_EQUAL_HEX16_MESSAGE(reference, result, names[b]);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_check_value);
+  RUN_TEST(test_backends_match_bitwise);
+  RUN_TEST(test_backends_match_bitwise_all_lengths);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,373 @@
+/**
+ * @file test_main.cpp
+ * @author mchacher
+ * @brief native unit tests of the LoRa task state machine
+ * the gateway modules are built with the host stubs of test/native: the test plays the transceiver (LoRa.h)
+ * and the LoRa task, which only runs process() when it takes a notification, as taskRxTx does
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <unity.h>
+// modules under test
+#include "lora_home_gateway.cpp"
+#include "packet_pool.cpp"
+#include "crc16.cpp"
+#include "duty_cycle.cpp"
+#include "node_table.cpp"
+#include "perf_stats.cpp"
+
+#define TEST_NETWORK_ID 0x1234
+#define TEST_NODE_ID 7
+
+// serial api and log ring, not under test
+uint32_t uart_rx_drop_counter = 0;
+static uint32_t credits_sent = 0;
+
+bool serial_api_send_sys_payload(uint8_t sys_type, const void *payload, uint8_t size, const UART_LINK_SETTINGS *link)
+{
+  credits_sent++;
+  return true;
+}
+
+// registers written by the last lora settings change, as logged
+static uint32_t retune_writes = 0;
+
+void log_ring_put(LOG_ID id, uint8_t argc, const uint32_t *args)
+{
+  if (LOG_ID_RETUNE == id)
+  {
+    retune_writes = args[1];
+  }
+}
+
+/**
+ * @brief run the LoRa task as long as it has notifications to take
+ *
+ * @param wait used to return the time the task would block for, after the last run
+ * @return uint32_t number of runs of the state machine
+ */
+static uint32_t run_lora_task(TickType_t *wait = NULL)
+{
+  uint32_t runs = 0;
+  native_current_task = task_lora;
+  while (0 != ulTaskNotifyTake(pdFALSE, 0))
+  {
+    TickType_t next = LoRaHomeGateway::process();
+    if (NULL != wait)
+    {
+      *wait = next;
+    }
+    runs++;
+  }
+  return runs;
+}
+
+/**
+ * @brief build a node uplink, with its crc
+ *
+ * @param frame frame, room for LH_FRAME_MAX_SIZE bytes
+ * @param message_type message type
+ * @param counter uplink counter
+ * @return uint8_t frame size
+ */
+static uint8_t build_uplink(uint8_t *frame, uint8_t message_type, uint16_t counter)
+{
+  const char *json = "{\"temperature\":21.5}";
+  LORA_HOME_PACKET *packet = (LORA_HOME_PACKET *)frame;
+  packet->header.nodeIdEmitter = TEST_NODE_ID;
+  packet->header.nodeIdRecipient = LH_NODE_ID_GATEWAY;
+  packet->header.messageType = message_type;
+  packet->header.networkID = TEST_NETWORK_ID;
+  packet->header.counter = counter;
+  packet->header.payloadSize = strlen(json);
+  memcpy(packet->json_payload, json, strlen(json));
+  uint8_t size = LH_FRAME_HEADER_SIZE + packet->header.payloadSize;
+  uint16_t crc = crc16_ccitt(frame, size);
+  memcpy(&frame[size], &crc, LH_FRAME_FOOTER_SIZE);
+  return size + LH_FRAME_FOOTER_SIZE;
+}
+
+/**
+ * @brief allocate a downlink, as forwarded by the host
+ *
+ * @param message_type message type
+ * @param counter downlink counter
+ * @return PACKET_BUFFER* packet buffer holding the lora home packet at PACKET_POOL_HEADROOM, crc appended by putPacket
+ */
+static PACKET_BUFFER *build_downlink(uint8_t message_type, uint16_t counter)
+{
+  PACKET_BUFFER *buffer = packet_pool_alloc();
+  LORA_HOME_PACKET *packet = (LORA_HOME_PACKET *)LH_FRAME(buffer);
+  packet->header.nodeIdEmitter = LH_NODE_ID_GATEWAY;
+  packet->header.nodeIdRecipient = TEST_NODE_ID;
+  packet->header.messageType = message_type;
+  packet->header.networkID = TEST_NETWORK_ID;
+  packet->header.counter = counter;
+  packet->header.payloadSize = 2;
+  memcpy(packet->json_payload, "{}", 2);
+  return buffer;
+}
+
+void setUp(void)
+{
+  // the transceiver is back listening between tests
+  TEST_ASSERT_EQUAL(NATIVE_LORA_RX, LoRa.mode);
+  TEST_ASSERT_EQUAL_UINT32(0, task_lora->notification);
+  native_time_us += 1000000;
+}
+
+void tearDown(void)
+{
+}
+
+/**
+ * @brief a frame received raises DIO0, the LoRa task runs once and forwards the frame once
+ * the rx timestamp is the DIO0 edge, not the time the task got to run
+ *
+ */
+void test_rx_done_handled_once(void)
+{
+  uint8_t frame[LH_FRAME_MAX_SIZE];
+  uint8_t size = build_uplink(frame, LH_MSG_TYPE_NODE_MSG_NO_ACK_REQ, 1);
+  uint32_t rx_counter = LoRaHomeGateway::rx_counter;
+  uint32_t fifo_reads = LoRa.fifo_reads;
+  uint8_t available = packet_pool_available();
+
+  uint64_t rx_done_ts = native_time_us;
+  LoRa.nativeReceive(frame, size);
+  TEST_ASSERT_EQUAL_UINT32(1, task_lora->notification);
+  native_time_us += 250;
+  TickType_t wait = 0;
+  TEST_ASSERT_EQUAL_UINT32(1, run_lora_task(&wait));
+  TEST_ASSERT_EQUAL_UINT32(rx_counter + 1, LoRaHomeGateway::rx_counter);
+  TEST_ASSERT_EQUAL_UINT32(fifo_reads + 1, LoRa.fifo_reads);
+  // nothing else to do: the task blocks until the next event, no polling
+  TEST_ASSERT_EQUAL_UINT32(pdMS_TO_TICKS(LORA_TASK_WAIT_TIMEOUT), wait);
+
+  PACKET_BUFFER *packet = NULL;
+  TEST_ASSERT_TRUE(lhg.popLoRaHomePayload(&packet, 0));
+  TEST_ASSERT_EQUAL_UINT32(size, packet->length);
+  TEST_ASSERT_EQUAL_MEMORY(frame, LH_FRAME(packet), size);
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)rx_done_ts, packet->rx_ts);
+  packet_pool_release(packet);
+  TEST_ASSERT_FALSE(lhg.popLoRaHomePayload(&packet, 0));
+
+  // a wake up on timeout finds the RxDone flag cleared
+  LoRaHomeGateway::process();
+  TEST_ASSERT_EQUAL_UINT32(rx_counter + 1, LoRaHomeGateway::rx_counter);
+  TEST_ASSERT_EQUAL_UINT32(fifo_reads + 1, LoRa.fifo_reads);
+  TEST_ASSERT_FALSE(lhg.popLoRaHomePayload(&packet, 0));
+  TEST_ASSERT_EQUAL_UINT8(available, packet_pool_available());
+}
+
+/**
+ * @brief a downlink queued wakes the LoRa task up, CadDone starts the transmission, TxDone is handled once
+ *
+ */
+void test_tx_done_handled_once(void)
+{
+  uint32_t tx_counter = LoRaHomeGateway::tx_counter;
+  size_t sent = LoRa.sent.size();
+  uint8_t available = packet_pool_available();
+
+  TEST_ASSERT_TRUE(lhg.putPacket(build_downlink(LH_MSG_TYPE_GW_MSG_NO_ACK, 1)));
+  TEST_ASSERT_EQUAL_UINT32(1, task_lora->notification);
+  TEST_ASSERT_EQUAL_UINT32(1, run_lora_task());
+  // listen before talk
+  TEST_ASSERT_EQUAL(NATIVE_LORA_CAD, LoRa.mode);
+
+  LoRa.nativeCadDone(false);
+  TEST_ASSERT_EQUAL_UINT32(1, run_lora_task());
+  TEST_ASSERT_EQUAL(NATIVE_LORA_TX, LoRa.mode);
+  TEST_ASSERT_EQUAL_size_t(sent + 1, LoRa.sent.size());
+  TEST_ASSERT_TRUE(LoRa.invert_iq);
+
+  native_time_us += 50000;
+  LoRa.nativeTxDone();
+  TEST_ASSERT_EQUAL_UINT32(1, task_lora->notification);
+  TickType_t wait = 0;
+  TEST_ASSERT_EQUAL_UINT32(1, run_lora_task(&wait));
+  TEST_ASSERT_EQUAL_UINT32(tx_counter + 1, LoRaHomeGateway::tx_counter);
+  TEST_ASSERT_EQUAL(NATIVE_LORA_RX, LoRa.mode);
+  TEST_ASSERT_FALSE(LoRa.invert_iq);
+  TEST_ASSERT_EQUAL_UINT32(pdMS_TO_TICKS(LORA_TASK_WAIT_TIMEOUT), wait);
+
+  // a wake up on timeout finds the TxDone flag cleared
+  LoRaHomeGateway::process();
+  TEST_ASSERT_EQUAL_UINT32(tx_counter + 1, LoRaHomeGateway::tx_counter);
+  TEST_ASSERT_EQUAL_size_t(sent + 1, LoRa.sent.size());
+  TEST_ASSERT_EQUAL_UINT8(available, packet_pool_available());
+}
+
+/**
+ * @brief complete the transmission started: CadDone on a free channel, then TxDone
+ *
+ * @return const std::vector<uint8_t>& frame transmitted
+ */
+static const std::vector<uint8_t> &complete_tx(void)
+{
+  TEST_ASSERT_EQUAL(NATIVE_LORA_CAD, LoRa.mode);
+  LoRa.nativeCadDone(false);
+  run_lora_task();
+  TEST_ASSERT_EQUAL(NATIVE_LORA_TX, LoRa.mode);
+  LoRa.nativeTxDone();
+  run_lora_task();
+  return LoRa.sent.back();
+}
+
+/**
+ * @brief a gateway ACK is sent before the downlinks queued, strict priority of the GW_ACK class
+ * whether put while listening with the best effort queue full, or during the transmission of a downlink
+ *
+ */
+void test_gw_ack_sent_before_queued_downlinks(void)
+{
+  uint8_t available = packet_pool_available();
+  for (uint16_t i = 0; i < 5; i++)
+  {
+    TEST_ASSERT_TRUE(lhg.putPacket(build_downlink(LH_MSG_TYPE_GW_MSG_NO_ACK, 10 + i)));
+  }
+  PACKET_BUFFER *probe = build_downlink(LH_MSG_TYPE_GW_MSG_NO_ACK, 15);
+  TEST_ASSERT_TRUE(lhg.isTxQueueFull(probe));
+  packet_pool_release(probe);
+  lhg.putAck(TEST_NODE_ID, 42);
+  TEST_ASSERT_EQUAL_UINT8(1, lhg.getTxQueueDepth(LH_TX_CLASS_GW_ACK));
+
+  // the ACK is the first frame selected, the downlinks stay queued
+  run_lora_task();
+  TEST_ASSERT_EQUAL_UINT8(0, lhg.getTxQueueDepth(LH_TX_CLASS_GW_ACK));
+  TEST_ASSERT_EQUAL_UINT8(5, lhg.getTxQueueDepth(LH_TX_CLASS_DOWNLINK_NO_ACK));
+  const LORA_HOME_ACK *ack = (const LORA_HOME_ACK *)complete_tx().data();
+  TEST_ASSERT_EQUAL_size_t(LH_FRAME_ACK_SIZE, LoRa.sent.back().size());
+  TEST_ASSERT_EQUAL_UINT8(LH_MSG_TYPE_GW_ACK, ack->header.messageType);
+  TEST_ASSERT_EQUAL_UINT8(TEST_NODE_ID, ack->header.nodeIdRecipient);
+  TEST_ASSERT_EQUAL_UINT16(42, ack->header.counter);
+
+  // an ACK put during the transmission of a downlink goes before the next one
+  TEST_ASSERT_EQUAL(NATIVE_LORA_CAD, LoRa.mode);
+  LoRa.nativeCadDone(false);
+  run_lora_task();
+  TEST_ASSERT_EQUAL(NATIVE_LORA_TX, LoRa.mode);
+  const LORA_HOME_PACKET *downlink = (const LORA_HOME_PACKET *)LoRa.sent.back().data();
+  TEST_ASSERT_EQUAL_UINT8(LH_MSG_TYPE_GW_MSG_NO_ACK, downlink->header.messageType);
+  TEST_ASSERT_EQUAL_UINT16(10, downlink->header.counter);
+  lhg.putAck(TEST_NODE_ID, 43);
+  LoRa.nativeTxDone();
+  run_lora_task();
+  ack = (const LORA_HOME_ACK *)complete_tx().data();
+  TEST_ASSERT_EQUAL_UINT8(LH_MSG_TYPE_GW_ACK, ack->header.messageType);
+  TEST_ASSERT_EQUAL_UINT16(43, ack->header.counter);
+
+  // then the downlinks, in order
+  for (uint16_t i = 1; i < 5; i++)
+  {
+    downlink = (const LORA_HOME_PACKET *)complete_tx().data();
+    TEST_ASSERT_EQUAL_UINT8(LH_MSG_TYPE_GW_MSG_NO_ACK, downlink->header.messageType);
+    TEST_ASSERT_EQUAL_UINT16(10 + i, downlink->header.counter);
+  }
+  TEST_ASSERT_EQUAL(NATIVE_LORA_RX, LoRa.mode);
+  TEST_ASSERT_EQUAL_UINT8(0, lhg.getTxQueueDepth(LH_TX_CLASS_DOWNLINK_NO_ACK));
+  TEST_ASSERT_EQUAL_UINT8(available, packet_pool_available());
+}
+
+/**
+ * @brief a reconfiguration during the LBT backoff keeps the frame deferred on the channel of its recipient
+ * switched to scan mode, a node never heard is sent to on LORA_SCAN_DEFAULT_CHANNEL, not on the first scanned channel
+ *
+ */
+void test_reconfigure_during_lbt_backoff(void)
+{
+  LORA_CONFIGURATION scan = {CH_SCAN, BW_125KHZ, SF_7, CR_5};
+  LORA_CONFIGURATION lc = {CH_1, BW_125KHZ, SF_7, CR_5};
+  uint8_t available = packet_pool_available();
+  PACKET_BUFFER *packet = build_downlink(LH_MSG_TYPE_GW_MSG_NO_ACK, 20);
+  ((LORA_HOME_PACKET *)LH_FRAME(packet))->header.nodeIdRecipient = TEST_NODE_ID + 1;
+  TEST_ASSERT_TRUE(lhg.putPacket(packet));
+  run_lora_task();
+  TEST_ASSERT_EQUAL(NATIVE_LORA_CAD, LoRa.mode);
+  TEST_ASSERT_EQUAL(CH_1, LoRa.frequency);
+
+  // channel busy, back to rx for the backoff, reconfigured meanwhile
+  LoRa.nativeCadDone(true);
+  run_lora_task();
+  TEST_ASSERT_EQUAL(NATIVE_LORA_RX, LoRa.mode);
+  lhg.reconfigure(&scan);
+  retune_writes = 0;
+  run_lora_task();
+  // the settings registers written by the transceiver library, the standby mode switch not counted
+  TEST_ASSERT_EQUAL_UINT32(4, retune_writes);
+  // scanning
+  TEST_ASSERT_EQUAL(NATIVE_LORA_CAD, LoRa.mode);
+
+  // backoff over, the channel is checked again on the channel of the recipient
+  native_time_us += (LBT_BACKOFF_MAX + 1) * 1000ULL;
+  LoRa.nativeCadDone(false);
+  run_lora_task();
+  TEST_ASSERT_EQUAL(NATIVE_LORA_CAD, LoRa.mode);
+  TEST_ASSERT_EQUAL(LORA_SCAN_DEFAULT_CHANNEL, LoRa.frequency);
+  const LORA_HOME_PACKET *downlink = (const LORA_HOME_PACKET *)complete_tx().data();
+  TEST_ASSERT_EQUAL_UINT16(20, downlink->header.counter);
+
+  // the sub-bands are charged apart, the heartbeat budget is the least one left over the scan set
+  uint32_t least = UINT32_MAX;
+  for (uint8_t i = 0; i < LORA_SCAN_CHANNEL_COUNT; i++)
+  {
+    TEST_ASSERT_EQUAL_UINT32(duty_cycle_remaining(LORA_SCAN_CHANNELS[i]), LoRaHomeGateway::channel_airtime_budget[i]);
+    least = (LoRaHomeGateway::channel_airtime_budget[i] < least) ? LoRaHomeGateway::channel_airtime_budget[i] : least;
+  }
+  TEST_ASSERT_NOT_EQUAL(LoRaHomeGateway::channel_airtime_budget[0], LoRaHomeGateway::channel_airtime_budget[2]);
+  TEST_ASSERT_EQUAL_UINT32(least, LoRaHomeGateway::airtime_budget);
+
+  lhg.reconfigure(&lc);
+  run_lora_task();
+  TEST_ASSERT_EQUAL(NATIVE_LORA_RX, LoRa.mode);
+  TEST_ASSERT_EQUAL(CH_1, LoRa.frequency);
+  TEST_ASSERT_EQUAL_UINT8(available, packet_pool_available());
+}
+
+/**
+ * @brief a gateway ACK on a busy channel is sent after LBT_ACK_MAX_ATTEMPTS channel checks, within ACK_TIMEOUT
+ *
+ */
+void test_gw_ack_lbt_attempts(void)
+{
+  uint32_t forced = LoRaHomeGateway::lbt_forced_counter;
+  size_t sent = LoRa.sent.size();
+  uint64_t start = native_time_us;
+  lhg.putAck(TEST_NODE_ID, 50);
+  run_lora_task();
+  for (uint8_t attempt = 1; attempt < LBT_ACK_MAX_ATTEMPTS; attempt++)
+  {
+    TEST_ASSERT_EQUAL(NATIVE_LORA_CAD, LoRa.mode);
+    LoRa.nativeCadDone(true);
+    run_lora_task();
+    TEST_ASSERT_EQUAL(NATIVE_LORA_RX, LoRa.mode);
+    // the task wakes up once the backoff is over
+    native_time_us += LBT_BACKOFF_MAX * 1000ULL;
+    LoRaHomeGateway::process();
+  }
+  TEST_ASSERT_EQUAL(NATIVE_LORA_CAD, LoRa.mode);
+  LoRa.nativeCadDone(true);
+  run_lora_task();
+  TEST_ASSERT_EQUAL(NATIVE_LORA_TX, LoRa.mode);
+  TEST_ASSERT_EQUAL_UINT32(forced + 1, LoRaHomeGateway::lbt_forced_counter);
+  TEST_ASSERT_EQUAL_size_t(sent + 1, LoRa.sent.size());
+  TEST_ASSERT_LESS_THAN_UINT32(ACK_TIMEOUT * 1000, (uint32_t)(native_time_us - start));
+  LoRa.nativeTxDone();
+  run_lora_task();
+}
+
+int main(int argc, char **argv)
+{
+  LORA_CONFIGURATION lc = {CH_1, BW_125KHZ, SF_7, CR_5};
+  lhg.setup(&lc, TEST_NETWORK_ID);
+  lhg.enable();
+  UNITY_BEGIN();
+  RUN_TEST(test_rx_done_handled_once);
+  RUN_TEST(test_tx_done_handled_once);
+  RUN_TEST(test_gw_ack_sent_before_queued_downlinks);
+  RUN_TEST(test_reconfigure_during_lbt_backoff);
+  RUN_TEST(test_gw_ack_lbt_attempts);
+  return UNITY_END();
+}
@@ -0,0 +1,127 @@
+/**
+ * @file test_main.cpp
+ * @author mchacher
+ * @brief native unit tests of the duplicate detection of the node table, node restarts included
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <unity.h>
+// module under test
+#include "node_table.cpp"
+
+#define TEST_CRC 0x5a5a
+
+static uint8_t node_id = 0;
+
+void setUp(void)
+{
+  // a node never heard per test
+  node_id++;
+  native_time_us += 60000000;
+}
+
+void tearDown(void)
+{
+}
+
+/**
+ * @brief a retransmission is a duplicate, a late frame is not, once
+ *
+ */
+void test_duplicate_and_late_frame(void)
+{
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 10, TEST_CRC));
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 12, TEST_CRC + 2));
+  TEST_ASSERT_TRUE(node_table_is_duplicate(node_id, 12, TEST_CRC + 2));
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 11, TEST_CRC + 1));
+  TEST_ASSERT_TRUE(node_table_is_duplicate(node_id, 11, TEST_CRC + 1));
+  TEST_ASSERT_TRUE(node_table_is_duplicate(node_id, 10, TEST_CRC));
+
+  NODE_TABLE_ENTRY entry;
+  node_table_get(node_id, &entry);
+  TEST_ASSERT_EQUAL_UINT32(3, entry.uplink_counter);
+  TEST_ASSERT_EQUAL_UINT32(0, entry.lost_counter);
+}
+
+/**
+ * @brief a counter far behind the last one is a restart, whatever the time
+ *
+ */
+void test_restart_far_behind(void)
+{
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 1000, TEST_CRC));
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 0, TEST_CRC));
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 1, TEST_CRC));
+  TEST_ASSERT_TRUE(node_table_is_duplicate(node_id, 1, TEST_CRC));
+}
+
+/**
+ * @brief counters already received, after a silence long enough for a restart, are new uplinks
+ *
+ */
+void test_restart_after_silence(void)
+{
+  for (uint16_t counter = 0; counter < 5; counter++)
+  {
+    TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, counter, TEST_CRC + counter));
+  }
+  native_time_us += (NODE_TABLE_RESTART_DELAY + 1) * 1000ULL;
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 0, TEST_CRC));
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 1, TEST_CRC + 1));
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 2, TEST_CRC + 2));
+  // retransmissions are still duplicates
+  TEST_ASSERT_TRUE(node_table_is_duplicate(node_id, 2, TEST_CRC + 2));
+}
+
+/**
+ * @brief retransmissions of the last uplink keep coming, however long: never taken as a restart
+ *
+ */
+void test_retransmissions_are_not_restarts(void)
+{
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 7, TEST_CRC));
+  for (uint8_t i = 0; i < 5; i++)
+  {
+    native_time_us += (NODE_TABLE_RESTART_DELAY / 2) * 1000ULL;
+    TEST_ASSERT_TRUE(node_table_is_duplicate(node_id, 7, TEST_CRC));
+  }
+}
+
+/**
+ * @brief the last counter with another content is a restart, right away
+ *
+ */
+void test_restart_same_counter_other_crc(void)
+{
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 0, TEST_CRC));
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 0, TEST_CRC + 1));
+  TEST_ASSERT_TRUE(node_table_is_duplicate(node_id, 0, TEST_CRC + 1));
+}
+
+/**
+ * @brief documented limitation: a quick restart behind the last counter has its first uplinks dropped
+ *
+ */
+void test_quick_restart_limitation(void)
+{
+  for (uint16_t counter = 0; counter < 5; counter++)
+  {
+    TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, counter, TEST_CRC + counter));
+  }
+  native_time_us += 1000000;
+  TEST_ASSERT_TRUE(node_table_is_duplicate(node_id, 3, TEST_CRC + 0x100));
+  TEST_ASSERT_FALSE(node_table_is_duplicate(node_id, 5, TEST_CRC + 0x105));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_duplicate_and_late_frame);
+  RUN_TEST(test_restart_far_behind);
+  RUN_TEST(test_restart_after_silence);
+  RUN_TEST(test_retransmissions_are_not_restarts);
+  RUN_TEST(test_restart_same_counter_other_crc);
+  RUN_TEST(test_quick_restart_limitation);
+  return UNITY_END();
+}
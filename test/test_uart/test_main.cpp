@@ -0,0 +1,549 @@
+/**
+ * @file test_main.cpp
+ * @author mchacher
+ * @brief native unit tests of the UART data link layer: byte stuffing and COBS framing, tx bursts and link switch
+ * the module is built with the host UART driver of test/native, its static encoders and decoders tested directly
+ * the bytes written by the tx path are captured by the host uart_write_bytes, write by write
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+#include <unity.h>
+// modules under test
+#include "uart.cpp"
+#include "packet_pool.cpp"
+#include "perf_stats.cpp"
+
+static const UART_FRAMING framings[] = {UART_FRAMING_STUFFING, UART_FRAMING_COBS};
+static const char *names[] = {"stuffing", "cobs"};
+
+/**
+ * @brief encode a message with a framing
+ *
+ * @param framing framing
+ * @param data message
+ * @param length message length
+ * @param out encoded bytes, room for UART_ENCODED_MAX_SIZE(length) bytes
+ * @return size_t number of bytes encoded
+ */
+static size_t encode(UART_FRAMING framing, const uint8_t *data, size_t length, uint8_t *out)
+{
+  if (UART_FRAMING_COBS == framing)
+  {
+    return uart_encode_cobs(data, length, out);
+  }
+  return uart_encode_stuffing(data, length, out);
+}
+
+/**
+ * @brief feed encoded bytes to the decoder, in chunks as read from the UART driver
+ *
+ * @param framing framing
+ * @param encoded encoded bytes
+ * @param size number of bytes
+ * @param chunk chunk size
+ */
+static void decode(UART_FRAMING framing, const uint8_t *encoded, size_t size, size_t chunk)
+{
+  uart_framing = framing;
+  for (size_t k = 0; k < size; k += chunk)
+  {
+    uart_decode(&encoded[k], ((size - k) < chunk) ? (size - k) : chunk);
+  }
+}
+
+/**
+ * @brief check the encoded frame: delimiters only at its ends, flags escaped inside
+ *
+ * @param framing framing
+ * @param encoded encoded bytes
+ * @param size number of bytes
+ * @param length message length
+ */
+static void check_encoded(UART_FRAMING framing, const uint8_t *encoded, size_t size, size_t length)
+{
+  if (UART_FRAMING_COBS == framing)
+  {
+    // constant overhead
+    TEST_ASSERT_EQUAL_size_t(length + 2, size);
+    TEST_ASSERT_NULL(memchr(encoded, UART_COBS_DELIMITER, size - 1));
+    TEST_ASSERT_EQUAL_HEX8(UART_COBS_DELIMITER, encoded[size - 1]);
+    return;
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(UART_ENCODED_MAX_SIZE(length), size);
+  TEST_ASSERT_EQUAL_HEX8(UART_FLAG_START, encoded[0]);
+  TEST_ASSERT_EQUAL_HEX8(UART_FLAG_STOP, encoded[size - 1]);
+  for (size_t i = 1; i < size - 1; i++)
+  {
+    if (UART_FLAG_ESC == encoded[i])
+    {
+      i++;
+      continue;
+    }
+    TEST_ASSERT_TRUE((UART_FLAG_START != encoded[i]) && (UART_FLAG_STOP != encoded[i]));
+  }
+}
+
+/**
+ * @brief check the message decoded from the rx queue
+ *
+ * @param data message expected
+ * @param length message length
+ */
+static void check_decoded(const uint8_t *data, size_t length)
+{
+  PACKET_BUFFER *buffer = NULL;
+  TEST_ASSERT_TRUE(uart_get_rx_buffer(&buffer, 0));
+  TEST_ASSERT_EQUAL_size_t(length, buffer->length);
+  TEST_ASSERT_EQUAL_MEMORY(data, buffer->data, length);
+  packet_pool_release(buffer);
+  TEST_ASSERT_FALSE(uart_get_rx_buffer(&buffer, 0));
+}
+
+/**
+ * @brief encode then decode a message with a framing, in chunks, and check the message decoded is identical
+ *
+ * @param framing framing
+ * @param data message
+ * @param length message length
+ * @param chunk chunk size
+ */
+static void check_round_trip(UART_FRAMING framing, const uint8_t *data, size_t length, size_t chunk)
+{
+  uint8_t encoded[UART_ENCODED_MAX_SIZE(PACKET_POOL_BLOCK_SIZE)];
+  uint32_t drops = uart_rx_drop_counter;
+  size_t size = encode(framing, data, length, encoded);
+  check_encoded(framing, encoded, size, length);
+  decode(framing, encoded, size, chunk);
+  check_decoded(data, length);
+  TEST_ASSERT_EQUAL_UINT32(drops, uart_rx_drop_counter);
+}
+
+/**
+ * @brief allocate a buffer holding a message with no byte to escape, encoded on length + 2 bytes with both framings
+ *
+ * @param length message length
+ * @param seed first byte of the message
+ * @return PACKET_BUFFER* buffer allocated
+ */
+static PACKET_BUFFER *alloc_message(uint8_t length, uint8_t seed)
+{
+  PACKET_BUFFER *buffer = packet_pool_alloc();
+  TEST_ASSERT_NOT_NULL(buffer);
+  for (uint8_t i = 0; i < length; i++)
+  {
+    buffer->data[i] = 0x80 | ((seed + i) & 0x3F);
+  }
+  buffer->length = length;
+  return buffer;
+}
+
+/**
+ * @brief append the encoded message of a buffer to the bytes expected on the UART
+ *
+ * @param expected bytes expected
+ * @param framing framing the buffer is sent with
+ * @param buffer buffer
+ */
+static void expect_message(std::vector<uint8_t> &expected, UART_FRAMING framing, const PACKET_BUFFER *buffer)
+{
+  uint8_t encoded[UART_ENCODED_MAX_SIZE(PACKET_POOL_BLOCK_SIZE)];
+  size_t size = encode(framing, buffer->data, buffer->length, encoded);
+  TEST_ASSERT_EQUAL_size_t(buffer->length + 2, size);
+  expected.insert(expected.end(), encoded, encoded + size);
+}
+
+/**
+ * @brief check the bytes written to the UART, and the size of each write
+ *
+ * @param expected bytes expected, in order
+ * @param writes size of each write expected
+ */
+static void check_written(const std::vector<uint8_t> &expected, const std::vector<size_t> &writes)
+{
+  TEST_ASSERT_EQUAL_size_t(writes.size(), native_uart_writes.size());
+  TEST_ASSERT_EQUAL_MEMORY(writes.data(), native_uart_writes.data(), writes.size() * sizeof(size_t));
+  TEST_ASSERT_EQUAL_size_t(expected.size(), native_uart_tx.size());
+  TEST_ASSERT_EQUAL_MEMORY(expected.data(), native_uart_tx.data(), expected.size());
+}
+
+void setUp(void)
+{
+  native_uart_tx.clear();
+  native_uart_writes.clear();
+  native_uart_baud_rate_offset = 0;
+  native_uart_tx_idle = true;
+}
+
+void tearDown(void)
+{
+  // every buffer back to the pool
+  TEST_ASSERT_EQUAL_UINT8(PACKET_POOL_SIZE, packet_pool_available());
+}
+
+/**
+ * @brief random messages of every length up to the largest one, whole or in chunks
+ *
+ */
+void test_round_trip_random(void)
+{
+  uint8_t data[PACKET_POOL_BLOCK_SIZE];
+  for (size_t f = 0; f < UART_FRAMING_COUNT; f++)
+  {
+    TEST_MESSAGE(names[f]);
+    for (size_t length = 0; length <= sizeof(data); length++)
+    {
+      for (size_t i = 0; i < length; i++)
+      {
+        data[i] = (uint8_t)esp_random();
+      }
+      check_round_trip(framings[f], data, length, UART_RX_CHUNK_SIZE);
+      check_round_trip(framings[f], data, length, 1 + (esp_random() % 16));
+    }
+  }
+}
+
+/**
+ * @brief messages made of zeros only, a COBS block per byte
+ *
+ */
+void test_round_trip_all_zero(void)
+{
+  uint8_t data[PACKET_POOL_BLOCK_SIZE] = {};
+  for (size_t f = 0; f < UART_FRAMING_COUNT; f++)
+  {
+    for (size_t length = 1; length <= sizeof(data); length++)
+    {
+      check_round_trip(framings[f], data, length, UART_RX_CHUNK_SIZE);
+      check_round_trip(framings[f], data, length, 1);
+    }
+  }
+}
+
+/**
+ * @brief messages made of delimiters only: START, STOP and ESC flags for byte stuffing (every byte escaped)
+ *
+ */
+void test_round_trip_all_delimiter(void)
+{
+  uint8_t data[PACKET_POOL_BLOCK_SIZE];
+  const uint8_t flags[] = {UART_FLAG_START, UART_FLAG_STOP, UART_FLAG_ESC};
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = flags[i % 3];
+  }
+  uint8_t encoded[UART_ENCODED_MAX_SIZE(PACKET_POOL_BLOCK_SIZE)];
+  TEST_ASSERT_EQUAL_size_t(UART_ENCODED_MAX_SIZE(sizeof(data)), uart_encode_stuffing(data, sizeof(data), encoded));
+  for (size_t f = 0; f < UART_FRAMING_COUNT; f++)
+  {
+    for (size_t length = 1; length <= sizeof(data); length++)
+    {
+      check_round_trip(framings[f], data, length, UART_RX_CHUNK_SIZE);
+      check_round_trip(framings[f], data, length, 3);
+    }
+  }
+}
+
+/**
+ * @brief COBS blocks of every size: a run of non zero bytes of each length, before and after a zero
+ *
+ */
+void test_round_trip_cobs_blocks(void)
+{
+  uint8_t data[PACKET_POOL_BLOCK_SIZE];
+  for (size_t run = 0; run < sizeof(data); run++)
+  {
+    memset(data, 0xA5, sizeof(data));
+    data[run] = 0;
+    check_round_trip(UART_FRAMING_COBS, data, run + 1, UART_RX_CHUNK_SIZE);
+    check_round_trip(UART_FRAMING_COBS, data, sizeof(data), UART_RX_CHUNK_SIZE);
+  }
+}
+
+/**
+ * @brief longest COBS block of the single block encoding: 253 non zero bytes, code 0xFE
+ * 254 bytes and more would need a 0xFF code block, messages are bounded by the static_assert of uart.cpp
+ * the decoder drops such a message as too long, and decodes the next one
+ *
+ */
+void test_cobs_longest_block(void)
+{
+  uint8_t data[253];
+  uint8_t encoded[sizeof(data) + 2];
+  memset(data, 0x5A, sizeof(data));
+  size_t size = uart_encode_cobs(data, sizeof(data), encoded);
+  check_encoded(UART_FRAMING_COBS, encoded, size, sizeof(data));
+  TEST_ASSERT_EQUAL_HEX8(0xFE, encoded[0]);
+
+  data[252] = 0;
+  size = uart_encode_cobs(data, sizeof(data), encoded);
+  check_encoded(UART_FRAMING_COBS, encoded, size, sizeof(data));
+  TEST_ASSERT_EQUAL_HEX8(0xFD, encoded[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, encoded[253]);
+
+  uint32_t drops = uart_rx_drop_counter;
+  decode(UART_FRAMING_COBS, encoded, size, UART_RX_CHUNK_SIZE);
+  TEST_ASSERT_EQUAL_UINT32(drops + 1, uart_rx_drop_counter);
+  check_round_trip(UART_FRAMING_COBS, data, PACKET_POOL_BLOCK_SIZE, UART_RX_CHUNK_SIZE);
+}
+
+/**
+ * @brief largest message accepted, one byte more is dropped and the decoder resynchronizes on the next message
+ *
+ */
+void test_max_size(void)
+{
+  uint8_t data[PACKET_POOL_BLOCK_SIZE + 1];
+  uint8_t encoded[UART_ENCODED_MAX_SIZE(sizeof(data))];
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (i % 2) ? UART_FLAG_ESC : 0;
+  }
+  for (size_t f = 0; f < UART_FRAMING_COUNT; f++)
+  {
+    check_round_trip(framings[f], data, PACKET_POOL_BLOCK_SIZE, UART_RX_CHUNK_SIZE);
+    uint32_t drops = uart_rx_drop_counter;
+    size_t size = encode(framings[f], data, sizeof(data), encoded);
+    decode(framings[f], encoded, size, UART_RX_CHUNK_SIZE);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(drops + 1, uart_rx_drop_counter, names[f]);
+    PACKET_BUFFER *buffer = NULL;
+    TEST_ASSERT_FALSE(uart_get_rx_buffer(&buffer, 0));
+    check_round_trip(framings[f], data, 10, UART_RX_CHUNK_SIZE);
+  }
+}
+
+/**
+ * @brief COBS frames corrupted or truncated, a code pointing beyond the delimiter, are rejected
+ * the decoder decodes the next frame
+ *
+ */
+void test_cobs_corrupted(void)
+{
+  uint8_t data[32];
+  uint8_t encoded[sizeof(data) + 2];
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (i % 8) ? (uint8_t)(i + 1) : 0;
+  }
+  size_t size = uart_encode_cobs(data, sizeof(data), encoded);
+  PACKET_BUFFER *buffer = NULL;
+
+  // byte lost before the delimiter, the last code points beyond the end
+  uint8_t truncated[sizeof(encoded)];
+  memcpy(truncated, encoded, size - 2);
+  truncated[size - 2] = UART_COBS_DELIMITER;
+  decode(UART_FRAMING_COBS, truncated, size - 1, UART_RX_CHUNK_SIZE);
+  TEST_ASSERT_FALSE(uart_get_rx_buffer(&buffer, 0));
+
+  // first code corrupted, pointing beyond the end
+  uint8_t corrupted[sizeof(encoded)];
+  memcpy(corrupted, encoded, size);
+  corrupted[0] = 0xF0;
+  decode(UART_FRAMING_COBS, corrupted, size, UART_RX_CHUNK_SIZE);
+  TEST_ASSERT_FALSE(uart_get_rx_buffer(&buffer, 0));
+
+  check_round_trip(UART_FRAMING_COBS, data, sizeof(data), UART_RX_CHUNK_SIZE);
+}
+
+/**
+ * @brief byte stuffing: bytes outside START and STOP flags are ignored, a message without STOP runs into the next one
+ * and is dropped once too long, the decoder then waits for the next START flag
+ *
+ */
+void test_stuffing_corrupted(void)
+{
+  uint8_t data[PACKET_POOL_BLOCK_SIZE];
+  uint8_t encoded[UART_ENCODED_MAX_SIZE(sizeof(data))];
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (uint8_t)esp_random() | 0x80;
+  }
+  PACKET_BUFFER *buffer = NULL;
+
+  // noise before the START flag
+  decode(UART_FRAMING_STUFFING, data, 16, UART_RX_CHUNK_SIZE);
+  TEST_ASSERT_FALSE(uart_get_rx_buffer(&buffer, 0));
+  check_round_trip(UART_FRAMING_STUFFING, data, 20, UART_RX_CHUNK_SIZE);
+
+  // STOP flag lost, the message runs into the next one
+  uint32_t drops = uart_rx_drop_counter;
+  size_t size = uart_encode_stuffing(data, sizeof(data), encoded);
+  decode(UART_FRAMING_STUFFING, encoded, size - 1, UART_RX_CHUNK_SIZE);
+  decode(UART_FRAMING_STUFFING, encoded, size, UART_RX_CHUNK_SIZE);
+  TEST_ASSERT_EQUAL_UINT32(drops + 1, uart_rx_drop_counter);
+  TEST_ASSERT_FALSE(uart_get_rx_buffer(&buffer, 0));
+  check_round_trip(UART_FRAMING_STUFFING, data, 20, UART_RX_CHUNK_SIZE);
+}
+
+/**
+ * @brief a burst is written before the next frame could overflow it: 6 frames of 140 bytes take 852 bytes,
+ * a 7th one could take up to 282 bytes, it opens the next burst
+ *
+ */
+void test_burst_split_by_size(void)
+{
+  std::vector<uint8_t> expected;
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    PACKET_BUFFER *buffer = alloc_message(140, i);
+    expect_message(expected, UART_FRAMING_STUFFING, buffer);
+    TEST_ASSERT_TRUE(uart_put_tx_buffer(buffer));
+  }
+  uart_tx_process();
+  check_written(expected, {6 * 142, 2 * 142});
+}
+
+/**
+ * @brief a burst holds UART_TX_BURST_FRAMES frames at most, whatever their size
+ * more frames than the tx queue holds, added to the burst directly
+ *
+ */
+void test_burst_split_by_frames(void)
+{
+  std::vector<uint8_t> expected;
+  for (uint8_t i = 0; i <= UART_TX_BURST_FRAMES; i++)
+  {
+    PACKET_BUFFER *buffer = alloc_message(4, i);
+    expect_message(expected, UART_FRAMING_STUFFING, buffer);
+    uart_burst_add(buffer);
+  }
+  uart_burst_flush();
+  check_written(expected, {UART_TX_BURST_FRAMES * 6, 6});
+}
+
+/**
+ * @brief the link switches right after the switch buffer is out: the frames before it at the former baud rate and framing,
+ * the frames after it at the new ones, in order
+ *
+ */
+void test_link_switch(void)
+{
+  const UART_LINK_SETTINGS initial = {UART_BAUD_RATE, UART_FRAMING_STUFFING};
+  const UART_LINK_SETTINGS link = {921600, UART_FRAMING_COBS};
+  uint32_t blocking_waits = native_uart_blocking_wait_counter;
+  std::vector<uint8_t> expected;
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    PACKET_BUFFER *buffer = alloc_message(20, i);
+    expect_message(expected, (i < 2) ? UART_FRAMING_STUFFING : UART_FRAMING_COBS, buffer);
+    TEST_ASSERT_TRUE((1 == i) ? uart_put_tx_buffer_switch(buffer, &link) : uart_put_tx_buffer(buffer));
+  }
+  uart_tx_process();
+  check_written(expected, {2 * 22, 2 * 22});
+  TEST_ASSERT_EQUAL_size_t(2 * 22, native_uart_baud_rate_offset);
+  TEST_ASSERT_EQUAL_UINT32(921600, native_uart_baud_rate);
+  TEST_ASSERT_EQUAL(UART_FRAMING_COBS, uart_framing);
+  TEST_ASSERT_NULL(uart_switch_buffer);
+  // the only wait for the last byte to be out
+  TEST_ASSERT_EQUAL_UINT32(blocking_waits + 1, native_uart_blocking_wait_counter);
+  uart_set_link(&initial);
+}
+
+/**
+ * @brief the switch buffer opens a burst, the one before it full: the link switches right after the switch buffer still
+ *
+ */
+void test_link_switch_after_split(void)
+{
+  const UART_LINK_SETTINGS initial = {UART_BAUD_RATE, UART_FRAMING_STUFFING};
+  const UART_LINK_SETTINGS link = {921600, UART_FRAMING_COBS};
+  std::vector<uint8_t> expected;
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    PACKET_BUFFER *buffer = alloc_message(140, i);
+    expect_message(expected, (i < 7) ? UART_FRAMING_STUFFING : UART_FRAMING_COBS, buffer);
+    TEST_ASSERT_TRUE((6 == i) ? uart_put_tx_buffer_switch(buffer, &link) : uart_put_tx_buffer(buffer));
+  }
+  uart_tx_process();
+  check_written(expected, {6 * 142, 142, 142});
+  TEST_ASSERT_EQUAL_size_t(7 * 142, native_uart_baud_rate_offset);
+  TEST_ASSERT_EQUAL_UINT32(921600, native_uart_baud_rate);
+  TEST_ASSERT_NULL(uart_switch_buffer);
+  uart_set_link(&initial);
+}
+
+/**
+ * @brief the latency of a profiled uplink is estimated from the bytes written and the baud rate, without waiting for the UART
+ *
+ */
+void test_uplink_latency_no_wait(void)
+{
+  PERF_STATS before;
+  PERF_STATS after;
+  uint32_t blocking_waits = native_uart_blocking_wait_counter;
+  // the bytes written by the previous tests are out
+  native_time_us += 1000000;
+  perf_stats_get(&before);
+  PACKET_BUFFER *buffer = alloc_message(20, 0);
+  buffer->cycles = 1;
+  buffer->rx_ts = (uint32_t)esp_timer_get_time();
+  TEST_ASSERT_TRUE(uart_put_tx_buffer(buffer));
+  uart_tx_process();
+  perf_stats_get(&after);
+  TEST_ASSERT_EQUAL_UINT32(blocking_waits, native_uart_blocking_wait_counter);
+  TEST_ASSERT_EQUAL_UINT32(before.uplink_counter + 1, after.uplink_counter);
+  TEST_ASSERT_EQUAL_UINT32((22 * 10 * 1000000) / UART_BAUD_RATE, (uint32_t)(after.uplink_latency_us - before.uplink_latency_us));
+}
+
+/**
+ * @brief byte stuffing: a message dropped is skipped up to its STOP flag, an escaped START flag inside it
+ * never starts a message, whether dropped as too long or for lack of a free buffer
+ *
+ */
+void test_stuffing_dropped_escaped_start(void)
+{
+  // the tail of the message, once decoded, would be a SYS reset message
+  const uint8_t tail[] = {UART_FLAG_START, 0x01, 0x00, 0x02, 0x01, 0xFE};
+  uint8_t data[PACKET_POOL_BLOCK_SIZE + 1 + sizeof(tail)];
+  uint8_t encoded[UART_ENCODED_MAX_SIZE(sizeof(data))];
+  memset(data, 0xA5, PACKET_POOL_BLOCK_SIZE + 1);
+  memcpy(&data[PACKET_POOL_BLOCK_SIZE + 1], tail, sizeof(tail));
+  PACKET_BUFFER *buffer = NULL;
+
+  // too long
+  uint32_t drops = uart_rx_drop_counter;
+  size_t size = uart_encode_stuffing(data, sizeof(data), encoded);
+  decode(UART_FRAMING_STUFFING, encoded, size, UART_RX_CHUNK_SIZE);
+  TEST_ASSERT_EQUAL_UINT32(drops + 1, uart_rx_drop_counter);
+  TEST_ASSERT_FALSE(uart_get_rx_buffer(&buffer, 0));
+  check_round_trip(UART_FRAMING_STUFFING, tail, sizeof(tail), UART_RX_CHUNK_SIZE);
+
+  // no buffer free, the escape split across chunks
+  PACKET_BUFFER *buffers[PACKET_POOL_SIZE];
+  for (uint8_t i = 0; i < PACKET_POOL_SIZE; i++)
+  {
+    buffers[i] = packet_pool_alloc();
+  }
+  size = uart_encode_stuffing(&data[PACKET_POOL_BLOCK_SIZE - 8], 8 + 1 + sizeof(tail), encoded);
+  decode(UART_FRAMING_STUFFING, encoded, 11, UART_RX_CHUNK_SIZE);
+  for (uint8_t i = 0; i < PACKET_POOL_SIZE; i++)
+  {
+    packet_pool_release(buffers[i]);
+  }
+  decode(UART_FRAMING_STUFFING, &encoded[11], size - 11, UART_RX_CHUNK_SIZE);
+  TEST_ASSERT_EQUAL_UINT32(drops + 2, uart_rx_drop_counter);
+  TEST_ASSERT_FALSE(uart_get_rx_buffer(&buffer, 0));
+  check_round_trip(UART_FRAMING_STUFFING, tail, sizeof(tail), UART_RX_CHUNK_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+  UART_LINK_SETTINGS link = {UART_BAUD_RATE, UART_FRAMING_STUFFING};
+  uart_init(&link);
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip_random);
+  RUN_TEST(test_round_trip_all_zero);
+  RUN_TEST(test_round_trip_all_delimiter);
+  RUN_TEST(test_round_trip_cobs_blocks);
+  RUN_TEST(test_cobs_longest_block);
+  RUN_TEST(test_max_size);
+  RUN_TEST(test_cobs_corrupted);
+  RUN_TEST(test_stuffing_corrupted);
+  RUN_TEST(test_stuffing_dropped_escaped_start);
+  RUN_TEST(test_burst_split_by_size);
+  RUN_TEST(test_burst_split_by_frames);
+  RUN_TEST(test_link_switch);
+  RUN_TEST(test_link_switch_after_split);
+  RUN_TEST(test_uplink_latency_no_wait);
+  return UNITY_END();
+}
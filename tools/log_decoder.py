@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Decode the SERIAL_MSG_TYPE_LOG frames sent by the dongle.
+
+Binary log frames start with LOG_RING_FRAME_MARKER (0x00), followed by records:
+ts (uint32, ms since boot), id (uint8), argc (uint8), argc args (uint32), little endian.
+The format of each log ID is read from the LOG_RING_IDS list of src/log_ring.h.
+Any other frame is a text log message.
+
+Reads one frame per line on stdin, the data of the serial packet in hex, e.g.
+    python3 tools/log_decoder.py < frames.txt
+"""
+import argparse
+import os
+import re
+import struct
+import sys
+
+LOG_RING_FRAME_MARKER = 0x00
+RECORD_HEADER = struct.Struct("<IBB")
+ARG = struct.Struct("<I")
+DEFAULT_HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "log_ring.h")
+
+
+def load_formats(header_path):
+    """Return the log formats, indexed by log ID, from the LOG_RING_IDS list."""
+    with open(header_path) as f:
+        source = f.read()
+    return [fmt for _, fmt in re.findall(r'X\((LOG_ID_\w+),\s*"((?:[^"\\]|\\.)*)"\)', source)]
+
+
+def format_record(formats, log_id, args):
+    """Apply the printf like format of a log ID to its raw arguments, %d and %i read them signed."""
+    if log_id >= len(formats):
+        return "unknown log id %u: %s" % (log_id, " ".join("%08x" % arg for arg in args))
+    fmt = formats[log_id]
+    conversions = re.findall(r"%[-+ #0]*\d*(?:\.\d+)?([a-zA-Z%])", fmt)
+    values = []
+    for conversion in conversions:
+        if conversion == "%":
+            continue
+        arg = args[len(values)] if len(values) < len(args) else 0
+        if conversion in "di" and arg & 0x80000000:
+            arg -= 1 << 32
+        values.append(arg)
+    return fmt % tuple(values)
+
+
+def decode_frame(formats, data):
+    """Return the (ts, text) logs of a frame, ts None for a text log message."""
+    if not data or data[0] != LOG_RING_FRAME_MARKER:
+        return [(None, data.decode("utf-8", errors="replace"))]
+    logs = []
+    offset = 1
+    while offset + RECORD_HEADER.size <= len(data):
+        ts, log_id, argc = RECORD_HEADER.unpack_from(data, offset)
+        offset += RECORD_HEADER.size
+        if offset + argc * ARG.size > len(data):
+            logs.append((ts, "truncated record"))
+            break
+        args = [ARG.unpack_from(data, offset + i * ARG.size)[0] for i in range(argc)]
+        offset += argc * ARG.size
+        logs.append((ts, format_record(formats, log_id, args)))
+    return logs
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--header", default=DEFAULT_HEADER, help="log_ring.h holding the log formats")
+    options = parser.parse_args()
+    formats = load_formats(options.header)
+    for line in sys.stdin:
+        line = line.strip().replace(":", "").replace(" ", "")
+        if not line:
+            continue
+        for ts, text in decode_frame(formats, bytes.fromhex(line)):
+            if ts is None:
+                print(text)
+            else:
+                print("%10.3f %s" % (ts / 1000.0, text))
+
+
+if __name__ == "__main__":
+    main()